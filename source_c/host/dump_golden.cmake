@@ -0,0 +1,31 @@
+# runs picolog_sim and compares the lines of its text dumps, run headers,
+# sample lines and the result line of each dump, with a golden file
+#
+#   cmake -D SIM=build/picolog_sim -D ARGS="-n;1000;-d" -D GOLDEN=dump_golden.txt -P dump_golden.cmake
+#
+# -D UPDATE=1 writes the golden file instead, from the build of the commit
+# the dump has to match
+
+execute_process(COMMAND ${SIM} ${ARGS} OUTPUT_VARIABLE out RESULT_VARIABLE rc)
+
+if(NOT rc EQUAL 0)
+    message(FATAL_ERROR "${SIM} ${ARGS} failed with ${rc}")
+endif()
+
+# flash report and timing lines are left out, they change with the store
+string(REGEX MATCHALL "\n(S |0x|[0-9][0-9][0-9][0-9][0-9][0-9][0-9][0-9] )[^\n]*" lines "\n${out}")
+list(JOIN lines "" dump)
+string(SUBSTRING "${dump}\n" 1 -1 dump)
+
+if(UPDATE)
+    file(WRITE ${GOLDEN} "${dump}")
+    return()
+endif()
+
+file(READ ${GOLDEN} golden)
+
+if(NOT dump STREQUAL golden)
+    get_filename_component(name ${GOLDEN} NAME)
+    file(WRITE ${name}.out "${dump}")
+    message(FATAL_ERROR "dump differs from ${GOLDEN}, see ${name}.out")
+endif()
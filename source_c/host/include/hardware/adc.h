@@ -0,0 +1,19 @@
+// hardware/adc.h host shim, picoLog native build
+// adc_read() returns a synthetic 12 bit LDR day/night curve over simulated time
+
+#pragma once
+
+#include "pico.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void adc_init(void);
+void adc_gpio_init(uint gpio);
+void adc_select_input(uint input);
+uint16_t adc_read(void);
+
+#ifdef __cplusplus
+}
+#endif
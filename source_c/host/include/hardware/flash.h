@@ -0,0 +1,21 @@
+// hardware/flash.h host shim, picoLog native build
+// programs and erases the RAM backed flash image of flash_sim.c
+
+#pragma once
+
+#include "pico.h"
+
+#define FLASH_PAGE_SIZE     (1u << 8)
+#define FLASH_SECTOR_SIZE   (1u << 12)
+#define FLASH_BLOCK_SIZE    (1u << 16)
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void flash_range_erase(uint32_t flash_offs, size_t count);
+void flash_range_program(uint32_t flash_offs, const uint8_t* data, size_t count);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,21 @@
+// hardware/regs/addressmap.h host shim, picoLog native build
+// XIP windows map onto the RAM flash image of flash_sim.c, the cache of the
+// allocating and non allocating windows is modeled by flash_sim_xip()
+
+#pragma once
+
+#include "pico.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+extern uint8_t flash_sim_mem[];
+
+#ifdef __cplusplus
+}
+#endif
+
+#define XIP_BASE                    ((uintptr_t)flash_sim_mem)
+#define XIP_NOALLOC_BASE            ((uintptr_t)flash_sim_mem)
+#define XIP_NOCACHE_NOALLOC_BASE    ((uintptr_t)flash_sim_mem)
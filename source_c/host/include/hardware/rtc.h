@@ -0,0 +1,28 @@
+// hardware/rtc.h host shim, picoLog native build
+// the rtc runs on simulated time, see pico/time.h
+
+#pragma once
+
+#include "pico.h"
+
+typedef struct{
+    int16_t year;
+    int8_t month;
+    int8_t day;
+    int8_t dotw;
+    int8_t hour;
+    int8_t min;
+    int8_t sec;
+}datetime_t;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void rtc_init(void);
+bool rtc_set_datetime(datetime_t* t);
+bool rtc_get_datetime(datetime_t* t);
+
+#ifdef __cplusplus
+}
+#endif
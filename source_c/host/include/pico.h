@@ -0,0 +1,14 @@
+// pico.h host shim, picoLog native build
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define PICO_FLASH_SIZE_BYTES   (2 * 1024 * 1024)       // W25Q16JV as on Pico board
+#define PICO_DEFAULT_LED_PIN    25
+
+typedef unsigned int uint;
+
+#define __uninitialized_ram(group)  group               // pico/platform.h, kept over reset on the Pico
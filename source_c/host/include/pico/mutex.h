@@ -0,0 +1,13 @@
+// pico/mutex.h host shim, picoLog native build
+
+#pragma once
+
+#include "pico.h"
+
+typedef struct recursive_mutex{
+    uint32_t enter_count;
+}recursive_mutex_t;
+
+static inline void recursive_mutex_init(recursive_mutex_t* mtx) { mtx->enter_count = 0; }
+static inline void recursive_mutex_enter_blocking(recursive_mutex_t* mtx) { mtx->enter_count++; }
+static inline void recursive_mutex_exit(recursive_mutex_t* mtx) { mtx->enter_count--; }
@@ -0,0 +1,19 @@
+// pico/time.h host shim, picoLog native build
+// time is simulated, it only advances by sleep_*() and sim_advance_us()
+
+#pragma once
+
+#include "pico.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint32_t time_us_32(void);
+uint64_t time_us_64(void);
+void sleep_us(uint64_t us);
+void sleep_ms(uint32_t ms);
+
+#ifdef __cplusplus
+}
+#endif
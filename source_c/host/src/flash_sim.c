@@ -0,0 +1,193 @@
+// flash_sim.c picoLog native build, RAM backed NOR flash
+//
+// same rules as the Pico SDK flash functions:
+// erase in FLASH_SECTOR_SIZE units to 0xff, program in FLASH_PAGE_SIZE units,
+// programming can only clear bits
+//
+// each call advances simulated time by the modeled latency, interrupts are
+// disabled around the calls by pico_hal just as on the Pico
+//
+// XIP reads cost QSPI transfers in continuous read mode (0xeb) at 62.5 MHz,
+// 24 bit address and mode in 8 clocks, 4 dummy clocks, 2 clocks per byte
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+#include "flash_sim.h"
+#include "hw_sim.h"
+
+#define WEAR_BUCKETS    8
+#define XIP_LINE        8                   // cache line bytes
+#define XIP_SETS        1024                // 16 KB in 2 ways
+#define XIP_WORD_NS     320                 // uncached 32 bit read, 20 clocks
+#define XIP_FILL_NS     448                 // line fill, 28 clocks
+#define XIP_HIT_NS      8                   // 32 bit read from cache, 1 cycle at 125 MHz
+
+const FlashSimTiming FLASH_SIM_TYP = { .opOverhead = 20, .pageProg = 400, .sectorErase = 45000 };
+const FlashSimTiming FLASH_SIM_MAX = { .opOverhead = 20, .pageProg = 3000, .sectorErase = 400000 };
+
+uint8_t flash_sim_mem[FLASH_SIM_SIZE];
+FlashSimStat flash_sim_stat;
+FlashSimTiming flash_sim_timing = FLASH_SIM_TYP;
+uint32_t flash_sim_wear[FLASH_SIM_SECTORS];
+
+static struct{
+    uint32_t tag[2];                        // line / XIP_SETS + 1, 0 invalid
+    uint8_t lru;                            // way to replace next
+}xipSet[XIP_SETS];
+
+void flash_sim_reset(void)
+{
+    memset(flash_sim_mem, 0xff, sizeof(flash_sim_mem));
+    flash_sim_xip_flush();
+    flash_sim_clear_stat();
+}
+
+void flash_sim_xip_flush(void)
+{
+    memset(xipSet, 0, sizeof(xipSet));
+}
+
+void flash_sim_xip(uint32_t offs, uint32_t size, int window)
+{
+    uint32_t words = (size + 3) / 4;
+
+    flash_sim_stat.xipReads++;
+    flash_sim_stat.xipBytes += size;
+
+    if(size == 0)
+        return;
+
+    if(window == FLASH_SIM_NOCACHE){
+        flash_sim_stat.xipFetches += words;
+        flash_sim_stat.xipNs += (uint64_t)words * XIP_WORD_NS;
+        return;
+    }
+
+    uint32_t fills = 0;
+
+    for(uint32_t l=offs/XIP_LINE; l<=(offs+size-1)/XIP_LINE; l++){
+        uint32_t tag = l / XIP_SETS + 1;
+        uint32_t set = l % XIP_SETS;
+
+        if(xipSet[set].tag[0] == tag)
+            xipSet[set].lru = 1;
+        else if(xipSet[set].tag[1] == tag)
+            xipSet[set].lru = 0;
+        else{
+            fills++;
+
+            if(window == FLASH_SIM_CACHE){
+                xipSet[set].tag[xipSet[set].lru] = tag;
+                xipSet[set].lru ^= 1;
+            }
+        }
+    }
+
+    flash_sim_stat.xipFetches += fills;
+    flash_sim_stat.xipNs += (uint64_t)fills * XIP_FILL_NS + (uint64_t)words * XIP_HIT_NS;
+}
+
+void flash_sim_clear_stat(void)
+{
+    memset(&flash_sim_stat, 0, sizeof(flash_sim_stat));
+    memset(flash_sim_wear, 0, sizeof(flash_sim_wear));
+    sim_clear_ints_off();
+}
+
+int flash_sim_load(const char* path)
+{
+    FILE* f = fopen(path, "rb");
+
+    if(!f)
+        return -1;
+
+    size_t n = fread(flash_sim_mem, 1, sizeof(flash_sim_mem), f);
+    fclose(f);
+
+    return n == sizeof(flash_sim_mem) ? 0 : -1;
+}
+
+int flash_sim_save(const char* path)
+{
+    FILE* f = fopen(path, "wb");
+
+    if(!f)
+        return -1;
+
+    size_t n = fwrite(flash_sim_mem, 1, sizeof(flash_sim_mem), f);
+    fclose(f);
+
+    return n == sizeof(flash_sim_mem) ? 0 : -1;
+}
+
+void flash_range_erase(uint32_t flash_offs, size_t count)
+{
+    assert(flash_offs % FLASH_SECTOR_SIZE == 0);
+    assert(count % FLASH_SECTOR_SIZE == 0);
+    assert(flash_offs + count <= FLASH_SIM_SIZE);
+
+    memset(flash_sim_mem + flash_offs, 0xff, count);
+    flash_sim_xip_flush();                  // as the SDK, no stale lines
+
+    for(uint32_t s=flash_offs/FLASH_SECTOR_SIZE; s<(flash_offs+count)/FLASH_SECTOR_SIZE; s++)
+        flash_sim_wear[s]++;
+
+    uint64_t us = flash_sim_timing.opOverhead + (uint64_t)flash_sim_timing.sectorErase * (count / FLASH_SECTOR_SIZE);
+    flash_sim_stat.busyUs += us;
+    sim_advance_us(us);
+
+    flash_sim_stat.eraseOps++;
+    flash_sim_stat.eraseSectors += count / FLASH_SECTOR_SIZE;
+}
+
+void flash_range_program(uint32_t flash_offs, const uint8_t* data, size_t count)
+{
+    assert(flash_offs % FLASH_PAGE_SIZE == 0);
+    assert(count % FLASH_PAGE_SIZE == 0);
+    assert(flash_offs + count <= FLASH_SIM_SIZE);
+
+    for(size_t i=0; i<count; i++){          // NOR, program clears bits only, 0xff leaves a byte
+        if(data[i]!=0xff && (data[i] & ~flash_sim_mem[flash_offs + i]))
+            flash_sim_stat.progViolations++;
+
+        flash_sim_mem[flash_offs + i] &= data[i];
+    }
+
+    flash_sim_xip_flush();
+
+    uint64_t us = flash_sim_timing.opOverhead + (uint64_t)flash_sim_timing.pageProg * (count / FLASH_PAGE_SIZE);
+    flash_sim_stat.busyUs += us;
+    sim_advance_us(us);
+
+    flash_sim_stat.progOps++;
+    flash_sim_stat.progBytes += count;
+}
+
+void flash_sim_report(FILE* f, uint32_t offs, uint32_t size)
+{
+    uint32_t s0 = offs / FLASH_SECTOR_SIZE;
+    uint32_t s1 = (offs + size) / FLASH_SECTOR_SIZE;
+    uint32_t min = UINT32_MAX, max = 0;
+    uint64_t sum = 0;
+
+    for(uint32_t s=s0; s<s1; s++){
+        if(flash_sim_wear[s] < min) min = flash_sim_wear[s];
+        if(flash_sim_wear[s] > max) max = flash_sim_wear[s];
+        sum += flash_sim_wear[s];
+    }
+
+    fprintf(f, "flash busy %.3f s, interrupts off %.3f s\n", flash_sim_stat.busyUs / 1e6, sim_ints_off_us() / 1e6);
+    fprintf(f, "prog %u ops %u bytes %u violations, erase %u ops %u sectors\n", flash_sim_stat.progOps,
+        flash_sim_stat.progBytes, flash_sim_stat.progViolations, flash_sim_stat.eraseOps, flash_sim_stat.eraseSectors);
+    fprintf(f, "wear %u sectors, erases min %u max %u mean %.2f\n", s1 - s0, min, max, s1>s0 ? (double)sum / (s1-s0) : 0);
+
+    uint32_t w = max / WEAR_BUCKETS + 1;        // bucket width in erases
+    uint32_t hist[WEAR_BUCKETS] = { 0 };
+
+    for(uint32_t s=s0; s<s1; s++)
+        hist[flash_sim_wear[s] / w]++;
+
+    for(uint32_t b=0; b<WEAR_BUCKETS && b*w<=max; b++)
+        fprintf(f, "  %6u..%-6u %u\n", b*w, b*w + w-1, hist[b]);
+}
@@ -0,0 +1,64 @@
+// flash_sim.h picoLog native build, RAM backed NOR flash
+
+#pragma once
+
+#include <stdio.h>
+#include "pico.h"
+#include "hardware/flash.h"
+
+#define FLASH_SIM_SIZE      PICO_FLASH_SIZE_BYTES
+#define FLASH_SIM_SECTORS   (FLASH_SIM_SIZE / FLASH_SECTOR_SIZE)
+
+#define FLASH_SIM_NOCACHE   0               // XIP window of flash_sim_xip()
+#define FLASH_SIM_CACHE     1               //   cached, allocates on miss
+#define FLASH_SIM_NOALLOC   2               //   cached, no allocation on miss
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct FlashSimTiming{              // NOR latency in us, default W25Q16JV typical
+    uint32_t opOverhead;                    // per SDK call, leave/enter XIP, flush cache
+    uint32_t pageProg;                      // per 256 byte page, tPP
+    uint32_t sectorErase;                   // per 4 KB sector, tSE
+}FlashSimTiming;
+
+typedef struct FlashSimStat{
+    uint32_t progOps;                       // flash_range_program calls
+    uint32_t progBytes;                     //                     bytes
+    uint32_t progViolations;                //                     bits 0 -> 1 requested
+    uint32_t eraseOps;                      // flash_range_erase calls
+    uint32_t eraseSectors;                  //                   sectors
+    uint64_t busyUs;                        // simulated program/erase time
+    uint32_t xipReads;                      // flash_sim_xip calls
+    uint32_t xipBytes;                      //               bytes
+    uint32_t xipFetches;                    //               QSPI transfers, words or line fills
+    uint64_t xipNs;                         //               modeled read time
+}FlashSimStat;
+
+extern uint8_t flash_sim_mem[FLASH_SIM_SIZE];
+extern FlashSimStat flash_sim_stat;
+extern FlashSimTiming flash_sim_timing;
+extern const FlashSimTiming FLASH_SIM_TYP;
+extern const FlashSimTiming FLASH_SIM_MAX;
+extern uint32_t flash_sim_wear[FLASH_SIM_SECTORS];  // erase count per sector
+
+void flash_sim_reset(void);                 // chip erase, clear statistics and wear
+void flash_sim_clear_stat(void);            // clear statistics and wear only
+void flash_sim_xip_flush(void);             // invalidate the modeled XIP cache
+int flash_sim_load(const char* path);       // load flash image, 0 ok
+int flash_sim_save(const char* path);       // save flash image, 0 ok
+
+// accounts a read of size bytes at flash offset offs through XIP window,
+// the bytes themselves are read by the caller, the RP2040 cache (16 KB,
+// 2 way, 8 byte lines) is modeled and flushed by program and erase as the
+// SDK does
+void flash_sim_xip(uint32_t offs, uint32_t size, int window);
+
+// print busy time, interrupts off time and wear histogram of sectors in
+// flash range offs..offs+size
+void flash_sim_report(FILE* f, uint32_t offs, uint32_t size);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,140 @@
+// hw_sim.c picoLog native build, simulated time, adc, rtc, interrupts
+
+#include <assert.h>
+#include <limits.h>
+#include <malloc.h>
+#include <math.h>
+#include <stdio.h>
+#include "pico/stdlib.h"
+#include "pico/time.h"
+#include "hardware/adc.h"
+#include "hardware/rtc.h"
+#include "hardware/sync.h"
+#include "hw_sim.h"
+
+#define ADC_NOISE       8                   // +-lsb
+#define SEC_PER_DAY     86400
+
+static uint64_t simUs;                      // simulated time in us
+
+static bool rtcSet;                         // rtc
+static datetime_t rtcBase;                  //     date set by rtc_set_datetime
+static uint64_t rtcBaseUs;                  //     at simulated time
+
+static uint32_t adcSeed = 1;                // noise lcg
+static uint32_t intsOff;                    // interrupt disable nesting
+static uint64_t intsOffUs;                  //                   start time
+static uint64_t intsOffSum;                 //                   accumulated time
+
+void sim_reset(void)
+{
+    mallopt(M_MMAP_MAX, 0);                 // pico_hal passes heap pointers as int handles,
+    void* p = malloc(1);                    // keep the heap in brk space below 2 GB (-no-pie)
+    assert((uintptr_t)p < INT_MAX);
+    free(p);
+
+    simUs = 0;
+    rtcSet = false;
+    adcSeed = 1;
+    intsOff = 0;
+    intsOffSum = 0;
+}
+
+void sim_advance_us(uint64_t us)
+{
+    simUs += us;
+}
+
+// stdio, host stdout is used as is
+
+bool stdio_init_all(void)
+{
+    return true;
+}
+
+// time
+
+uint32_t time_us_32(void) { return (uint32_t)simUs; }
+
+uint64_t time_us_64(void) { return simUs; }
+
+void sleep_us(uint64_t us) { sim_advance_us(us); }
+
+void sleep_ms(uint32_t ms) { sim_advance_us((uint64_t)ms * 1000); }
+
+// interrupts
+
+uint32_t save_and_disable_interrupts(void)
+{
+    if(intsOff == 0)
+        intsOffUs = simUs;
+
+    return intsOff++;
+}
+
+void restore_interrupts(uint32_t status)
+{
+    intsOff = status;
+
+    if(intsOff == 0)
+        intsOffSum += simUs - intsOffUs;
+}
+
+uint64_t sim_ints_off_us(void) { return intsOffSum; }
+
+void sim_clear_ints_off(void) { intsOffSum = 0; }
+
+// rtc
+
+void rtc_init(void)
+{
+    rtcSet = false;
+}
+
+bool rtc_set_datetime(datetime_t* t)
+{
+    rtcBase = *t;
+    rtcBaseUs = simUs;
+    rtcSet = true;
+    return true;
+}
+
+bool rtc_get_datetime(datetime_t* t)                // time of day only, date does not roll over
+{
+    if(!rtcSet)
+        return false;
+
+    uint32_t s = rtcBase.hour * 3600 + rtcBase.min * 60 + rtcBase.sec;
+    s = (s + (simUs - rtcBaseUs) / 1000000) % SEC_PER_DAY;
+
+    *t = rtcBase;
+    t->hour = s / 3600;
+    t->min = s / 60 % 60;
+    t->sec = s % 60;
+    return true;
+}
+
+// adc, ldr on a day/night cycle, bright at noon
+
+void adc_init(void) {}
+
+void adc_gpio_init(uint gpio) { (void)gpio; }
+
+void adc_select_input(uint input) { (void)input; }
+
+uint16_t adc_read(void)
+{
+    datetime_t t;
+    uint32_t s;
+
+    if(rtc_get_datetime(&t))
+        s = t.hour * 3600 + t.min * 60 + t.sec;
+    else
+        s = (simUs / 1000000) % SEC_PER_DAY;
+
+    double day = -cos(2 * M_PI * s / SEC_PER_DAY);   // -1 midnight .. 1 noon
+    adcSeed = adcSeed * 1664525 + 1013904223;
+    int v = 0x0800 + (int)(0x0700 * day) + (int)(adcSeed >> 28) % (ADC_NOISE + 1) * 2 - ADC_NOISE;
+
+    return v < 0 ? 0 : v > 0x0fff ? 0x0fff : v;
+}
@@ -0,0 +1,18 @@
+// hw_sim.h picoLog native build, simulated time, adc, rtc, interrupts
+
+#pragma once
+
+#include "pico.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void sim_reset(void);                       // time 0, rtc unset, adc noise reseeded
+void sim_advance_us(uint64_t us);           // let simulated time pass
+uint64_t sim_ints_off_us(void);             // simulated time spent with interrupts disabled
+void sim_clear_ints_off(void);
+
+#ifdef __cplusplus
+}
+#endif
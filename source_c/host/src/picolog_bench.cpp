@@ -0,0 +1,340 @@
+// picolog_bench.cpp picoLog native build, logging hot path benchmark
+//
+// runs Sample::sample() on simulated flash for every interval class the
+// firmware knows (5 s .. 24 h) and reports flash cost per logged sample
+//
+// usage: picolog_bench [-n samples] [-s sync] [-F] [-a] [-m] [-d] [-j] [-o out.csv] [-b baseline.csv] [-t tolerance]
+//   -n  samples per run                    (default 20000)
+//   -s  buffer flushes per file sync       (default 1)
+//   -F  data file in lfs                   (default sample log)
+//   -a  lfs alloc_bitmap allocator         (default lookahead)
+//   -m  worst case flash timing            (default typical)
+//   -d  text dump throughput of n samples at 15 s instead, output to a
+//       scratch file, cpu time per sample and MB/s of text
+//   -j  json instead of csv on stdout
+//   -o  also write csv to file, use it as next baseline
+//   -b  compare with baseline csv, exit 2 on regression
+//   -t  regression tolerance in percent    (default 5)
+//
+// cpu time depends on the host, it is reported but never compared
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "sample.h"
+#include "config.h"
+#include "flash_sim.h"
+#include "hw_sim.h"
+
+extern "C" const char* LOG_BASE;            // pico_hal.c
+extern "C" struct lfs_config pico_cfg;
+
+#define MAX_RUNS    16
+#define DUMP_REPS   20                      // dumps per throughput run
+
+static const uint32_t intervals[] = { 5, 10, 15, 20, 30, 60, 300, 3600, 86400 };
+
+typedef struct Result{
+    uint32_t interval;                      // s
+    uint32_t bufSize;                       // samples per flush
+    uint32_t samples;
+    uint32_t errors;
+    double progBytes;                       // per sample
+    double erases;                          //
+    double commits;                         //
+    double traverses;                       //
+    double busyUs;                          //
+    double intsOffUs;                       //
+    double cpuUs;                           //
+    double writeAmp;                        // programmed / logged bytes
+    uint32_t maxWear;                       // erases of most worn sector
+}Result;
+
+// deterministic metrics compared against the baseline, lower is better
+static const struct{
+    const char* name;
+    size_t off;
+}metrics[] = {
+    { "prog_bytes",  offsetof(Result, progBytes) },
+    { "erases",      offsetof(Result, erases) },
+    { "commits",     offsetof(Result, commits) },
+    { "traverses",   offsetof(Result, traverses) },
+    { "busy_us",     offsetof(Result, busyUs) },
+    { "ints_off_us", offsetof(Result, intsOffUs) }
+};
+
+static const char* CSV_HEAD = "interval,buf_size,samples,errors,prog_bytes,erases,commits,traverses,"
+                              "busy_us,ints_off_us,cpu_us,write_amp,max_wear";
+
+static uint32_t syncFlushes = 1;
+static bool fileStore = false;
+
+static void run(uint32_t interval, uint32_t n, Result* r)
+{
+    sim_reset();
+    flash_sim_reset();
+
+    Sample::init();
+    Config::init();
+    Config::setInterval(interval);
+
+    if(fileStore)
+        Config::setStore(0);
+
+    uint32_t v = interval;                      // as sample() in main.cpp
+    Sample::setStore(Config::getStore());
+    Sample::setSegment(Config::getSegment() * 1024);
+    Sample::setInterval(v);
+    Sample::setBatch(Config::getBatch(), Config::getMaxAge() / v);
+    Sample::setSync(syncFlushes);
+    Sample::start(Config::getDateYMD(), Config::getDateHMS());
+    Sample::remove();
+
+    flash_sim_clear_stat();
+    struct lfs_stats ls = lfs_stats;
+    uint32_t errors = 0;
+    clock_t c0 = clock();
+
+    for(uint32_t i=0; i<n; i++){
+        if(Sample::sample() != FLASH_OK)
+            errors++;
+
+        sim_advance_us((uint64_t)v * 1000000);
+    }
+
+    double cpu = (double)(clock() - c0) / CLOCKS_PER_SEC;
+    uint32_t s0 = (uint32_t)(uintptr_t)LOG_BASE / FLASH_SECTOR_SIZE;
+    uint32_t s1 = s0 + (pico_log_size() + pico_cfg.block_count * pico_cfg.block_size) / FLASH_SECTOR_SIZE;
+
+    r->interval = interval;
+    r->bufSize = Sample::getBatchSamples();
+    r->samples = n;
+    r->errors = errors;
+    r->progBytes = (double)flash_sim_stat.progBytes / n;
+    r->erases = (double)flash_sim_stat.eraseSectors / n;
+    r->commits = (double)(lfs_stats.commits - ls.commits) / n;
+    r->traverses = (double)(lfs_stats.traverses - ls.traverses) / n;
+    r->busyUs = (double)flash_sim_stat.busyUs / n;
+    r->intsOffUs = (double)sim_ints_off_us() / n;
+    r->cpuUs = cpu * 1e6 / n;
+    r->writeAmp = r->progBytes / SAMPLE_BYTES;
+    r->maxWear = 0;
+
+    for(uint32_t s=s0; s<s1; s++)
+        if(flash_sim_wear[s] > r->maxWear)
+            r->maxWear = flash_sim_wear[s];
+}
+
+// Sample::dump() of the samples logged by run() with stdout on a scratch
+// file, prints "store,samples,text_bytes,cpu_us,mb_s"
+//
+static void dumpBench(uint32_t n)
+{
+    Result r;
+    run(15, n, &r);
+
+    FILE* f = tmpfile();
+    int fd = dup(1);
+    int32_t size = 0;
+    Session first;
+
+    fflush(stdout);
+    dup2(fileno(f), 1);
+    clock_t c0 = clock();
+
+    for(int i=0; i<DUMP_REPS; i++)
+        Sample::dump(0, 0xffffffff, &size, &first);
+
+    fflush(stdout);
+    double cpu = (double)(clock() - c0) / CLOCKS_PER_SEC / DUMP_REPS;
+    long bytes = lseek(1, 0, SEEK_END) / DUMP_REPS;
+    dup2(fd, 1);
+    close(fd);
+    fclose(f);
+
+    printf("store,samples,text_bytes,cpu_us,mb_s\n");
+    printf("%s,%d,%ld,%.3f,%.2f\n", fileStore ? "file" : "log", size / SAMPLE_BYTES, bytes,
+        size ? cpu * 1e6 / (size / SAMPLE_BYTES) : 0, cpu ? bytes / cpu / 1e6 : 0);
+}
+
+static void printCsv(FILE* f, const Result* r, int runs)
+{
+    fprintf(f, "%s\n", CSV_HEAD);
+
+    for(int i=0; i<runs; i++, r++)
+        fprintf(f, "%u,%u,%u,%u,%.3f,%.6f,%.6f,%.6f,%.3f,%.3f,%.3f,%.3f,%u\n", r->interval, r->bufSize,
+            r->samples, r->errors, r->progBytes, r->erases, r->commits, r->traverses, r->busyUs,
+            r->intsOffUs, r->cpuUs, r->writeAmp, r->maxWear);
+}
+
+static void printJson(FILE* f, const Result* r, int runs)
+{
+    fprintf(f, "[\n");
+
+    for(int i=0; i<runs; i++, r++)
+        fprintf(f, "  {\"interval\": %u, \"buf_size\": %u, \"samples\": %u, \"errors\": %u, "
+            "\"prog_bytes\": %.3f, \"erases\": %.6f, \"commits\": %.6f, \"traverses\": %.6f, "
+            "\"busy_us\": %.3f, \"ints_off_us\": %.3f, \"cpu_us\": %.3f, \"write_amp\": %.3f, "
+            "\"max_wear\": %u}%s\n", r->interval, r->bufSize, r->samples, r->errors, r->progBytes,
+            r->erases, r->commits, r->traverses, r->busyUs, r->intsOffUs, r->cpuUs, r->writeAmp,
+            r->maxWear, i<runs-1 ? "," : "");
+
+    fprintf(f, "]\n");
+}
+
+static int readCsv(const char* path, Result* r)
+{
+    FILE* f = fopen(path, "r");
+
+    if(!f)
+        return -1;
+
+    char line[256];
+    int runs = 0;
+
+    if(!fgets(line, sizeof(line), f)){             // header
+        fclose(f);
+        return -1;
+    }
+
+    while(runs<MAX_RUNS && fgets(line, sizeof(line), f)){
+        if(sscanf(line, "%u,%u,%u,%u,%lf,%lf,%lf,%lf,%lf,%lf,%lf,%lf,%u", &r->interval, &r->bufSize,
+            &r->samples, &r->errors, &r->progBytes, &r->erases, &r->commits, &r->traverses, &r->busyUs,
+            &r->intsOffUs, &r->cpuUs, &r->writeAmp, &r->maxWear) == 13){
+            r++;
+            runs++;
+        }
+    }
+
+    fclose(f);
+    return runs;
+}
+
+// prints changes against baseline to stderr, returns number of regressions
+//
+static int compare(const Result* res, int runs, const Result* base, int bruns, double tol)
+{
+    int regressions = 0;
+
+    for(int i=0; i<runs; i++){
+        const Result* b = NULL;
+
+        for(int j=0; j<bruns; j++)
+            if(base[j].interval == res[i].interval)
+                b = &base[j];
+
+        if(!b){
+            fprintf(stderr, "%6u s  no baseline\n", res[i].interval);
+            continue;
+        }
+
+        for(size_t m=0; m<sizeof(metrics)/sizeof(metrics[0]); m++){
+            double x = *(const double*)((const char*)&res[i] + metrics[m].off);
+            double y = *(const double*)((const char*)b + metrics[m].off);
+            double d = y ? (x - y) / y * 100 : (x ? 100 : 0);
+            bool bad = d > tol;
+
+            if(d<-tol || bad)
+                fprintf(stderr, "%6u s  %-12s %12.3f -> %12.3f  %+7.1f %%%s\n", res[i].interval,
+                    metrics[m].name, y, x, d, bad ? "  REGRESSION" : "");
+
+            regressions += bad;
+        }
+    }
+
+    return regressions;
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t n = 20000;
+    bool json = false;
+    bool dump = false;
+    const char* out = NULL;
+    const char* baseline = NULL;
+    double tol = 5;
+
+    for(int i=1; i<argc; i++){
+        if(strcmp(argv[i], "-n")==0 && i+1<argc)
+            n = strtoul(argv[++i], NULL, 0);
+        else if(strcmp(argv[i], "-s")==0 && i+1<argc)
+            syncFlushes = strtoul(argv[++i], NULL, 0);
+        else if(strcmp(argv[i], "-F") == 0)
+            fileStore = true;
+        else if(strcmp(argv[i], "-a") == 0)
+            pico_cfg.alloc_bitmap = true;
+        else if(strcmp(argv[i], "-m") == 0)
+            flash_sim_timing = FLASH_SIM_MAX;
+        else if(strcmp(argv[i], "-d") == 0)
+            dump = true;
+        else if(strcmp(argv[i], "-j") == 0)
+            json = true;
+        else if(strcmp(argv[i], "-o")==0 && i+1<argc)
+            out = argv[++i];
+        else if(strcmp(argv[i], "-b")==0 && i+1<argc)
+            baseline = argv[++i];
+        else if(strcmp(argv[i], "-t")==0 && i+1<argc)
+            tol = strtod(argv[++i], NULL);
+        else{
+            printf("usage: picolog_bench [-n samples] [-s sync] [-F] [-a] [-m] [-d] [-j] [-o out.csv] [-b baseline.csv] [-t tolerance]\n");
+            return 1;
+        }
+    }
+
+    if(n == 0)
+        n = 1;
+
+    if(dump){
+        dumpBench(n);
+        return 0;
+    }
+
+    Result base[MAX_RUNS];                      // read first, -o may overwrite it
+    int bruns = 0;
+
+    if(baseline && (bruns = readCsv(baseline, base)) < 0){
+        fprintf(stderr, "error: cant read %s\n", baseline);
+        return 1;
+    }
+
+    Result res[MAX_RUNS];
+    int runs = sizeof(intervals) / sizeof(intervals[0]);
+
+    for(int i=0; i<runs; i++)
+        run(intervals[i], n, &res[i]);
+
+    if(json)
+        printJson(stdout, res, runs);
+    else
+        printCsv(stdout, res, runs);
+
+    if(out){
+        FILE* f = fopen(out, "w");
+
+        if(!f){
+            fprintf(stderr, "error: cant write %s\n", out);
+            return 1;
+        }
+
+        printCsv(f, res, runs);
+        fclose(f);
+    }
+
+    int err = 0;
+
+    for(int i=0; i<runs; i++)
+        if(res[i].errors)
+            err = 1;
+
+    if(baseline){
+        int reg = compare(res, runs, base, bruns, tol);
+        fprintf(stderr, "%d regressions against %s\n", reg, baseline);
+
+        if(reg)
+            err = 2;
+    }
+
+    return err;
+}
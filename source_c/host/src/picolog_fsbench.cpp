@@ -0,0 +1,354 @@
+// picolog_fsbench.cpp picoLog native build, file system micro benchmark
+//
+// fills the lfs partition to several levels, then measures
+//   mount     pico_mount of the filled partition
+//   append    steady state appends with sync, one block allocation each
+// for the lookahead allocator and the alloc_bitmap allocator
+//
+// with -x it writes a metadata log as the data file store does (segment
+// files appended with sync, index rewritten per segment), then measures
+// the modeled XIP read time of a cold pico_mount and of pico_open of the
+// newest segment and the index, for the uncached and the cached window
+//
+// usage: picolog_fsbench [-r repeats] [-x] [-j]
+//   -r  mounts and appends per fill level  (default 200)
+//   -x  XIP read cost of mount and open instead
+//   -j  json instead of csv
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "sample.h"
+#include "flash_sim.h"
+#include "hw_sim.h"
+
+extern "C" const char* FS_BASE;             // pico_hal.c
+extern "C" struct lfs_config pico_cfg;
+
+#define BENCH_FILE      "data.bin"
+#define FILL_CHUNK      1024                // bytes per fill write
+#define APPEND_SIZE     64                  // bytes per steady state append
+#define META_SEGMENTS   30                  // segment files of the metadata log
+#define META_SEGMENT    4096                // bytes per segment file, -g 4
+#define META_BATCH      256                 // bytes per synced append, BATCH_MIN
+#define META_INDEX      16                  // index bytes per segment
+
+static const uint32_t fills[] = { 10, 25, 50, 75, 90 };  // percent of partition
+
+typedef struct Result{
+    const char* alloc;
+    uint32_t fill;                          // percent
+    uint32_t used;                          // blocks
+    double mountUs;                         // cpu per mount
+    double mountTraverses;                  //     per mount
+    double appendUs;                        // cpu per append
+    double allocs;                          //     per append
+    double traverses;                       //     per append
+}Result;
+
+typedef struct XipResult{
+    const char* window;
+    uint32_t commits;                       // metadata log
+    double mountReads;                      // block device reads per mount
+    double mountBytes;                      //
+    double mountFetches;                    // QSPI transfers per mount
+    double mountUs;                         // modeled read time per mount
+    double openReads;                       // same per open of segment and index
+    double openBytes;
+    double openFetches;
+    double openUs;
+}XipResult;
+
+static int (*halRead)(lfs_block_t block, lfs_off_t off, void* buffer, lfs_size_t size);
+static int xipWindow;
+
+static double cpuUs(clock_t c0)
+{
+    return (double)(clock() - c0) * 1e6 / CLOCKS_PER_SEC;
+}
+
+static bool fill(uint32_t percent)
+{
+    uint8_t buf[FILL_CHUNK];
+    memset(buf, 0x5a, sizeof(buf));
+
+    if(pico_mount(true) != LFS_ERR_OK)
+        return false;
+
+    int file = pico_open(BENCH_FILE, LFS_O_WRONLY | LFS_O_CREAT | LFS_O_APPEND);
+
+    if(file < 0)
+        return false;
+
+    while(true){
+        struct pico_fsstat_t stat;
+        pico_fsstat(&stat);
+
+        if(stat.blocks_used * 100 >= stat.block_count * percent)
+            break;
+
+        pico_write(file, buf, sizeof(buf));
+        pico_fflush(file);
+    }
+
+    pico_close(file);
+    pico_unmount();
+    return true;
+}
+
+static void run(bool bitmap, uint32_t percent, uint32_t repeats, Result* r)
+{
+    sim_reset();
+    flash_sim_reset();
+    pico_cfg.alloc_bitmap = bitmap;
+
+    r->alloc = bitmap ? "bitmap" : "lookahead";
+    r->fill = percent;
+
+    if(!fill(percent)){
+        printf("error: fill %u %%\n", percent);
+        exit(1);
+    }
+
+    struct lfs_stats ls = lfs_stats;
+    clock_t c0 = clock();
+
+    for(uint32_t i=0; i<repeats; i++){
+        pico_mount(false);
+
+        if(i != repeats-1)
+            pico_unmount();
+    }
+
+    r->mountUs = cpuUs(c0) / repeats;
+    r->mountTraverses = (double)(lfs_stats.traverses - ls.traverses) / repeats;
+
+    struct pico_fsstat_t stat;
+    pico_fsstat(&stat);
+    r->used = stat.blocks_used;
+
+    uint8_t buf[APPEND_SIZE];
+    memset(buf, 0xa5, sizeof(buf));
+    int file = pico_open(BENCH_FILE, LFS_O_WRONLY | LFS_O_APPEND);
+
+    ls = lfs_stats;
+    c0 = clock();
+
+    for(uint32_t i=0; i<repeats; i++){
+        pico_write(file, buf, sizeof(buf));
+        pico_fflush(file);
+    }
+
+    r->appendUs = cpuUs(c0) / repeats;
+    r->allocs = (double)(lfs_stats.allocs - ls.allocs) / repeats;
+    r->traverses = (double)(lfs_stats.traverses - ls.traverses) / repeats;
+
+    pico_close(file);
+    pico_unmount();
+}
+
+// block device read through the modeled XIP window
+//
+static int xipRead(lfs_block_t block, lfs_off_t off, void* buffer, lfs_size_t size)
+{
+    flash_sim_xip((uint32_t)(uintptr_t)FS_BASE + block * pico_cfg.block_size + off, size, xipWindow);
+    return halRead(block, off, buffer, size);
+}
+
+static void segName(char* name, uint32_t seg)
+{
+    sprintf(name, "data/%05u.bin", seg);
+}
+
+static bool metaLog(uint32_t* commits)
+{
+    uint8_t buf[META_BATCH];
+    uint8_t index[META_SEGMENTS * META_INDEX];
+    char name[32];
+
+    memset(buf, 0x5a, sizeof(buf));
+    memset(index, 0xa5, sizeof(index));
+    sim_reset();
+    flash_sim_reset();
+    uint32_t c0 = lfs_stats.commits;
+
+    if(pico_mount(true)!=LFS_ERR_OK || pico_mkdir("data")!=LFS_ERR_OK)
+        return false;
+
+    for(uint32_t s=0; s<META_SEGMENTS; s++){
+        segName(name, s);
+        int file = pico_open(name, LFS_O_WRONLY | LFS_O_CREAT | LFS_O_APPEND);
+
+        if(file < 0)
+            return false;
+
+        for(uint32_t i=0; i<META_SEGMENT/META_BATCH; i++){
+            pico_write(file, buf, sizeof(buf));
+            pico_fflush(file);
+        }
+
+        pico_close(file);
+
+        if((file = pico_open(INDEX_FILE_NAME, LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC)) < 0)
+            return false;
+
+        pico_write(file, index, (s + 1) * META_INDEX);
+        pico_close(file);
+    }
+
+    *commits = lfs_stats.commits - c0;
+    pico_unmount();
+    return true;
+}
+
+// a cold cache for every mount as after reset, the opens follow with the
+// lines the mount left
+//
+static void xipRun(int window, uint32_t commits, uint32_t repeats, XipResult* r)
+{
+    char name[32];
+    segName(name, META_SEGMENTS - 1);
+
+    memset(r, 0, sizeof(XipResult));
+    r->window = window==FLASH_SIM_CACHE ? "cached" : "uncached";
+    r->commits = commits;
+    xipWindow = window;
+
+    for(uint32_t i=0; i<repeats; i++){
+        flash_sim_xip_flush();
+        FlashSimStat s = flash_sim_stat;
+        pico_mount(false);
+
+        r->mountReads += flash_sim_stat.xipReads - s.xipReads;
+        r->mountBytes += flash_sim_stat.xipBytes - s.xipBytes;
+        r->mountFetches += flash_sim_stat.xipFetches - s.xipFetches;
+        r->mountUs += (flash_sim_stat.xipNs - s.xipNs) / 1e3;
+
+        s = flash_sim_stat;
+        int file = pico_open(name, LFS_O_RDONLY);
+        int index = pico_open(INDEX_FILE_NAME, LFS_O_RDONLY);
+
+        r->openReads += flash_sim_stat.xipReads - s.xipReads;
+        r->openBytes += flash_sim_stat.xipBytes - s.xipBytes;
+        r->openFetches += flash_sim_stat.xipFetches - s.xipFetches;
+        r->openUs += (flash_sim_stat.xipNs - s.xipNs) / 1e3;
+
+        if(file<0 || index<0){
+            printf("error: open %s\n", file<0 ? name : INDEX_FILE_NAME);
+            exit(1);
+        }
+
+        pico_close(file);
+        pico_close(index);
+        pico_unmount();
+    }
+
+    r->mountReads /= repeats;
+    r->mountBytes /= repeats;
+    r->mountFetches /= repeats;
+    r->mountUs /= repeats;
+    r->openReads /= repeats;
+    r->openBytes /= repeats;
+    r->openFetches /= repeats;
+    r->openUs /= repeats;
+}
+
+static void xipBench(uint32_t repeats, bool json)
+{
+    uint32_t commits;
+    XipResult res[2];
+
+    if(!metaLog(&commits)){
+        printf("error: metadata log\n");
+        exit(1);
+    }
+
+    halRead = pico_cfg.read;
+    pico_cfg.read = xipRead;
+
+    xipRun(FLASH_SIM_NOCACHE, commits, repeats, &res[0]);
+    xipRun(FLASH_SIM_CACHE, commits, repeats, &res[1]);
+
+    pico_cfg.read = halRead;
+
+    if(json)
+        printf("[\n");
+    else
+        printf("window,commits,mount_reads,mount_bytes,mount_fetches,mount_us,open_reads,open_bytes,open_fetches,open_us\n");
+
+    for(int i=0; i<2; i++){
+        XipResult* r = &res[i];
+
+        if(json)
+            printf("  {\"window\": \"%s\", \"commits\": %u, \"mount_reads\": %.0f, \"mount_bytes\": %.0f, "
+                "\"mount_fetches\": %.0f, \"mount_us\": %.1f, \"open_reads\": %.0f, \"open_bytes\": %.0f, "
+                "\"open_fetches\": %.0f, \"open_us\": %.1f}%s\n", r->window, r->commits, r->mountReads,
+                r->mountBytes, r->mountFetches, r->mountUs, r->openReads, r->openBytes, r->openFetches,
+                r->openUs, i<1 ? "," : "");
+        else
+            printf("%s,%u,%.0f,%.0f,%.0f,%.1f,%.0f,%.0f,%.0f,%.1f\n", r->window, r->commits, r->mountReads,
+                r->mountBytes, r->mountFetches, r->mountUs, r->openReads, r->openBytes, r->openFetches, r->openUs);
+    }
+
+    if(json)
+        printf("]\n");
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t repeats = 200;
+    bool json = false;
+    bool xip = false;
+
+    for(int i=1; i<argc; i++){
+        if(strcmp(argv[i], "-r")==0 && i+1<argc)
+            repeats = strtoul(argv[++i], NULL, 0);
+        else if(strcmp(argv[i], "-x") == 0)
+            xip = true;
+        else if(strcmp(argv[i], "-j") == 0)
+            json = true;
+        else{
+            printf("usage: picolog_fsbench [-r repeats] [-x] [-j]\n");
+            return 1;
+        }
+    }
+
+    if(repeats == 0)
+        repeats = 1;
+
+    if(xip){
+        xipBench(repeats, json);
+        return 0;
+    }
+
+    const int n = sizeof(fills) / sizeof(fills[0]);
+    Result res[2 * n];
+
+    for(int b=0; b<2; b++)
+        for(int i=0; i<n; i++)
+            run(b, fills[i], repeats, &res[b*n + i]);
+
+    if(json)
+        printf("[\n");
+    else
+        printf("alloc,fill_pct,used_blocks,mount_us,mount_traverses,append_us,allocs,traverses\n");
+
+    for(int i=0; i<2*n; i++){
+        Result* r = &res[i];
+
+        if(json)
+            printf("  {\"alloc\": \"%s\", \"fill_pct\": %u, \"used_blocks\": %u, \"mount_us\": %.3f, "
+                "\"mount_traverses\": %.3f, \"append_us\": %.3f, \"allocs\": %.3f, \"traverses\": %.4f}%s\n",
+                r->alloc, r->fill, r->used, r->mountUs, r->mountTraverses, r->appendUs, r->allocs,
+                r->traverses, i<2*n-1 ? "," : "");
+        else
+            printf("%s,%u,%u,%.3f,%.3f,%.3f,%.3f,%.4f\n", r->alloc, r->fill, r->used, r->mountUs,
+                r->mountTraverses, r->appendUs, r->allocs, r->traverses);
+    }
+
+    if(json)
+        printf("]\n");
+
+    return 0;
+}
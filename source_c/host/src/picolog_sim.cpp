@@ -0,0 +1,341 @@
+// picolog_sim.cpp picoLog native build, runs a sampling session on simulated flash
+//
+// usage: picolog_sim [-n samples] [-i interval] [-s sync] [-b batch] [-r maxage] [-F] [-R] [-g segment] [-D date] [-T time] [-a] [-m] [-d] [-w from to] [-q x] [-Q x] [-t tier] [-e mode n] [-S from to] [-p] [-k] [-l n] [-B seq] [-O offset len] [-C seq index] [-f image]
+//   -n  number of samples                  (default 240), 0 only queries the
+//       stored samples without starting a session, as main after reset
+//   -i  sample interval in seconds         (default config, 15)
+//   -s  buffer flushes per file sync       (default config, 1)
+//   -b  RAM batch in bytes                 (default config, 256)
+//   -r  max age of unsaved samples in s    (default config, 3600)
+//   -F  data file in lfs instead of the sample log
+//   -R  ring mode, drops the oldest log sector or data segment when full
+//   -g  data segment size in KB            (default config, 16)
+//   -D  session start date yyyymmdd        (default config)
+//   -T                 time hhmmss
+//   -a  append to existing samples
+//   -m  worst case flash timing            (default typical)
+//   -d  dump samples afterwards
+//   -w  dump samples from <= t < to only, seconds since 1970
+//   -q  dump blocks that may hold samples below x
+//   -Q                                    above x
+//   -t  dump mean, min and max of every 10^tier samples
+//   -e  dump every n samples as mean (mode 1), min and max (2) or first (3)
+//   -S  count, min, max, mean and stddev of samples from <= t < to
+//   -p  p1, p50 and p99 of the last session and its last day
+//   -k  reset after the session with sketch.bin cut short, the quantiles
+//       fail to load, the RAM tail is kept
+//   -l  dump the newest n samples from the RAM tail, all for 0
+//   -B  binary dump in frames from seq on, written last to stdout
+//   -O  binary dump of len bytes of samples from byte offset on, same
+//   -C  samples stored, dump_from offset of cursor seq index and the cursor
+//       after the newest sample
+//   -f  flash image file, loaded before and saved after the session
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "sample.h"
+#include "config.h"
+#include "flash_sim.h"
+#include "hw_sim.h"
+
+extern "C" const char* FS_BASE;             // pico_hal.c
+extern "C" const char* LOG_BASE;
+extern "C" struct lfs_config pico_cfg;
+
+static void usage()
+{
+    printf("usage: picolog_sim [-n samples] [-i interval] [-s sync] [-b batch] [-r maxage] [-F] [-R] [-g segment] [-D date] [-T time] [-a] [-m] [-d] [-w from to] [-q x] [-Q x] [-t tier] [-e mode n] [-S from to] [-p] [-k] [-l n] [-B seq] [-O offset len] [-C seq index] [-f image]\n");
+    exit(1);
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t n = 240;
+    uint32_t interval = 0;
+    uint32_t sync = 0;
+    uint32_t batch = 0;
+    uint32_t maxAge = 0;
+    uint32_t segment = 0;
+    uint32_t date = 0;
+    int32_t hms = -1;
+    bool append = false;
+    bool fileStore = false;
+    bool ring = false;
+    bool dump = false;
+    uint32_t from = 0, to = 0xffffffff;
+    int32_t below = -1, above = -1;
+    int32_t tier = -1;
+    int32_t deci = -1;
+    uint32_t deciN = 1;
+    bool stats = false;
+    bool quant = false;
+    bool badSketch = false;
+    int32_t tail = -1;
+    int32_t bin = -1;
+    int64_t offset = -1;
+    uint32_t len = 0;
+    int64_t cSeq = -1;
+    uint32_t cIndex = 0;
+    uint32_t sFrom = 0, sTo = 0;
+    const char* image = NULL;
+
+    for(int i=1; i<argc; i++){
+        if(strcmp(argv[i], "-n")==0 && i+1<argc)
+            n = strtoul(argv[++i], NULL, 0);
+        else if(strcmp(argv[i], "-i")==0 && i+1<argc)
+            interval = strtoul(argv[++i], NULL, 0);
+        else if(strcmp(argv[i], "-a") == 0)
+            append = true;
+        else if(strcmp(argv[i], "-F") == 0)
+            fileStore = true;
+        else if(strcmp(argv[i], "-R") == 0)
+            ring = true;
+        else if(strcmp(argv[i], "-g")==0 && i+1<argc)
+            segment = strtoul(argv[++i], NULL, 0);
+        else if(strcmp(argv[i], "-D")==0 && i+1<argc)
+            date = strtoul(argv[++i], NULL, 10);
+        else if(strcmp(argv[i], "-T")==0 && i+1<argc)
+            hms = strtoul(argv[++i], NULL, 10);
+        else if(strcmp(argv[i], "-s")==0 && i+1<argc)
+            sync = strtoul(argv[++i], NULL, 0);
+        else if(strcmp(argv[i], "-b")==0 && i+1<argc)
+            batch = strtoul(argv[++i], NULL, 0);
+        else if(strcmp(argv[i], "-r")==0 && i+1<argc)
+            maxAge = strtoul(argv[++i], NULL, 0);
+        else if(strcmp(argv[i], "-m") == 0)
+            flash_sim_timing = FLASH_SIM_MAX;
+        else if(strcmp(argv[i], "-d") == 0)
+            dump = true;
+        else if(strcmp(argv[i], "-w")==0 && i+2<argc){
+            from = strtoul(argv[++i], NULL, 0);
+            to = strtoul(argv[++i], NULL, 0);
+            dump = true;
+        }
+        else if(strcmp(argv[i], "-q")==0 && i+1<argc)
+            below = strtoul(argv[++i], NULL, 0);
+        else if(strcmp(argv[i], "-Q")==0 && i+1<argc)
+            above = strtoul(argv[++i], NULL, 0);
+        else if(strcmp(argv[i], "-t")==0 && i+1<argc)
+            tier = strtoul(argv[++i], NULL, 0);
+        else if(strcmp(argv[i], "-e")==0 && i+2<argc){
+            deci = strtoul(argv[++i], NULL, 0);
+            deciN = strtoul(argv[++i], NULL, 0);
+        }
+        else if(strcmp(argv[i], "-S")==0 && i+2<argc){
+            sFrom = strtoul(argv[++i], NULL, 0);
+            sTo = strtoul(argv[++i], NULL, 0);
+            stats = true;
+        }
+        else if(strcmp(argv[i], "-p") == 0)
+            quant = true;
+        else if(strcmp(argv[i], "-k") == 0)
+            badSketch = true;
+        else if(strcmp(argv[i], "-l")==0 && i+1<argc)
+            tail = strtoul(argv[++i], NULL, 0);
+        else if(strcmp(argv[i], "-B")==0 && i+1<argc)
+            bin = strtoul(argv[++i], NULL, 0);
+        else if(strcmp(argv[i], "-O")==0 && i+2<argc){
+            offset = strtoul(argv[++i], NULL, 0);
+            len = strtoul(argv[++i], NULL, 0);
+        }
+        else if(strcmp(argv[i], "-C")==0 && i+2<argc){
+            cSeq = strtoul(argv[++i], NULL, 0);
+            cIndex = strtoul(argv[++i], NULL, 0);
+        }
+        else if(strcmp(argv[i], "-f")==0 && i+1<argc)
+            image = argv[++i];
+        else
+            usage();
+    }
+
+    sim_reset();
+    flash_sim_reset();
+
+    if(image && flash_sim_load(image) != 0)
+        printf("new flash image %s\n", image);
+
+    uint8_t err;
+
+    if((err = Sample::init()) != FLASH_OK){
+        printf("error: Sample::init %u\n", err);
+        return 1;
+    }
+
+    if((err = Config::init()) != FLASH_OK){
+        printf("error: Config::init %u\n", err);
+        return 1;
+    }
+
+    Sample::import(Config::getDateYMD(), Config::getDateHMS(), Config::getInterval());   // as main.cpp
+
+    if(interval)
+        Config::setInterval(interval);
+
+    if(sync)
+        Config::setSync(sync);
+
+    if(batch)
+        Config::setBatch(batch);
+
+    if(maxAge)
+        Config::setMaxAge(maxAge);
+
+    Config::setAppend(append);
+
+    if(fileStore)
+        Config::setStore(0);
+
+    if(ring)
+        Config::setRing(1);
+
+    if(segment)
+        Config::setSegment(segment);
+
+    if(date)
+        Config::setDateYMD(date);
+
+    if(hms >= 0)
+        Config::setDateHMS(hms);
+
+    uint32_t v = Config::getInterval();         // as sample() in main.cpp
+    Sample::setStore(Config::getStore());
+    Sample::setRing(Config::getRing());
+    Sample::setSegment(Config::getSegment() * 1024);
+    Sample::setInterval(v);
+    Sample::setBatch(Config::getBatch(), Config::getMaxAge() / v);
+    Sample::setSync(Config::getSync());
+
+    if(n){
+        Sample::start(Config::getDateYMD(), Config::getDateHMS());
+
+        if(!Config::getAppend())
+            Sample::remove();
+    }
+
+    flash_sim_clear_stat();
+    clock_t c0 = clock();
+    uint32_t errors = 0;
+
+    for(uint32_t i=0; i<n; i++){
+        if(Sample::sample() != FLASH_OK)
+            errors++;
+
+        sim_advance_us((uint64_t)v * 1000000);
+    }
+
+    double cpu = (double)(clock() - c0) / CLOCKS_PER_SEC;
+
+    printf("samples %u interval %u s errors %u\n", n, v, errors);
+    printf("cpu %.3f ms, %.2f us/sample\n", cpu * 1e3, n ? cpu * 1e6 / n : 0);
+    flash_sim_report(stdout, (uint32_t)(uintptr_t)LOG_BASE, pico_log_size() + pico_cfg.block_count * pico_cfg.block_size);
+
+    if(n)
+        printf("per sample: flash busy %.1f us, %.1f prog bytes, %.4f erases\n", (double)flash_sim_stat.busyUs / n,
+            (double)flash_sim_stat.progBytes / n, (double)flash_sim_stat.eraseSectors / n);
+
+    if(badSketch){
+        int f = pico_open(SKETCH_FILE_NAME, LFS_O_WRONLY | LFS_O_TRUNC);
+
+        if(f >= 0)
+            pico_close(f);
+
+        Sample::init();                         // reset, RAM kept
+        Sketch ses, day;
+
+        if(Sample::quantiles(&ses, &day) != FLASH_OK)
+            printf("sketch lost\n");
+    }
+
+    if(dump){
+        int32_t size;
+        Session first;
+
+        if(Sample::dump(from, to, &size, &first) == FLASH_OK)
+            printf("%08u %06u %06u %d\n", first.dateYMD, first.dateHMS, first.interval, size/2);
+    }
+
+    if(tier >= 0){
+        int32_t size;
+        Session first;
+
+        if(Sample::dumpTier(tier, &size, &first) == FLASH_OK)
+            printf("%08u %06u %06u %d\n", first.dateYMD, first.dateHMS, first.interval, size/2);
+    }
+
+    if(deci >= 0){
+        int32_t size;
+        Session first;
+
+        if(Sample::dumpDeci(deci, deciN, &size, &first) == FLASH_OK)
+            printf("%08u %06u %06u %d\n", first.dateYMD, first.dateHMS, first.interval, size/2);
+    }
+
+    if(stats){
+        Stats st;
+
+        if(Sample::stats(sFrom, sTo, &st) == FLASH_OK)
+            printf("%u %u %u %u.%02u %u.%02u\n", st.count, st.min, st.max,
+                st.mean / 100, st.mean % 100, st.stddev / 100, st.stddev % 100);
+    }
+
+    if(tail >= 0){
+        int32_t size;
+        Session first;
+
+        if(Sample::tail(tail, &size, &first) == FLASH_OK)
+            printf("%08u %06u %06u %d\n", first.dateYMD, first.dateHMS, first.interval, size/2);
+        else
+            printf("error: no samples in RAM\n");
+    }
+
+    if(quant){
+        Sketch ses, day;
+
+        if(Sample::quantiles(&ses, &day) == FLASH_OK){
+            printf("session %08u %06u %u %u %u %u\n", ses.dateYMD, ses.dateHMS, ses.count,
+                Quantile::get(&ses, 1), Quantile::get(&ses, 50), Quantile::get(&ses, 99));
+            printf("day %08u %06u %u %u %u %u\n", day.dateYMD, day.dateHMS, day.count,
+                Quantile::get(&day, 1), Quantile::get(&day, 50), Quantile::get(&day, 99));
+        }
+    }
+
+    if(cSeq >= 0){
+        Cursor c;
+
+        if(Sample::cursor(cSeq, cIndex, &c) == FLASH_OK)
+            printf("cursor %u %u %u %u %u\n", c.count, c.offset, c.seq, c.index, c.gap);
+    }
+
+    if(below>=0 || above>=0){
+        int32_t size;
+        Session first;
+
+        if(Sample::find(below >= 0, below>=0 ? below : above, &size, &first) == FLASH_OK)
+            printf("%08u %06u %06u %d\n", first.dateYMD, first.dateHMS, first.interval, size/2);
+    }
+
+    if(bin >= 0){
+        int32_t size;
+        Session first;
+
+        fflush(stdout);
+        Sample::dumpBin(bin, &size, &first);
+    }
+
+    if(offset >= 0){
+        int32_t size;
+        Session first;
+
+        fflush(stdout);
+        Sample::dumpFrom(offset, len, &size, &first);
+    }
+
+    if(image && flash_sim_save(image) != 0){
+        printf("error: cant write %s\n", image);
+        return 1;
+    }
+
+    return errors ? 1 : 0;
+}
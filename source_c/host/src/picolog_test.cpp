@@ -0,0 +1,217 @@
+// picolog_test.cpp picoLog native build, checks run by ctest
+//
+// usage: picolog_test check, one of
+//   quantile  p1, p50 and p99 of a sketch against the exact percentiles of
+//             a stream with sparse tails on both sides of a narrow body,
+//             that halves the sketch some hundred times
+//   fsused    blocks_used of pico_fsstat, kept by the allocator, against a
+//             traversal by lfs_fs_size after append, sync, rename, truncate,
+//             remove, directory removal, remount and random file operations,
+//             for the lookahead and the bitmap allocator
+//
+// prints a line per compared value, exit 1 if one is off
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "quantile.h"
+#include "extra/pico_hal.h"
+#include "flash_sim.h"
+#include "hw_sim.h"
+
+extern "C" struct lfs_config pico_cfg;
+
+#define QUANT_SAMPLES   10000000
+#define QUANT_TAIL      15                  // per mille of samples below and above the body
+#define FS_OPS          3000                // random file operations
+#define FS_FILL         40                  // blocks used, above all files are removed
+
+static uint32_t seed = 1;
+
+static uint32_t rnd(uint32_t n)
+{
+    seed = seed * 1664525 + 1013904223;
+    return (uint32_t)(((uint64_t)(seed >> 8) * n) >> 24);
+}
+
+static bool check(const char* what, uint32_t got, uint32_t want, uint32_t tol)
+{
+    bool ok = got + tol >= want && got <= want + tol;
+    printf("%-12s %5u exact %5u %s\n", what, got, want, ok ? "ok" : "fail");
+    return ok;
+}
+
+// body within one bin, it overflows every 2^15 samples, the tails spread
+// over the bins below and above get a few samples between halvings
+//
+static bool quantile()
+{
+    static uint32_t hist[SKETCH_RANGE];
+    static const uint8_t pct[] = { 1, 50, 99 };
+    Sketch s;
+    bool ok = true;
+
+    Quantile::clear(&s, 0, 0);
+
+    for(uint32_t i=0; i<QUANT_SAMPLES; i++){
+        uint32_t r = rnd(1000);
+        uint16_t x = r < QUANT_TAIL ? rnd(2944) :
+            r < 2 * QUANT_TAIL ? 3072 + rnd(1024) : 2944 + rnd(SKETCH_WIDTH);
+
+        Quantile::add(&s, x);
+        hist[x]++;
+    }
+
+    for(uint8_t p=0; p<sizeof(pct); p++){
+        uint64_t rank = (uint64_t)QUANT_SAMPLES * pct[p] / 100;
+        uint64_t cum = 0;
+        uint32_t v = 0;
+
+        while(v<SKETCH_RANGE-1 && (cum += hist[v]) < rank)
+            v++;
+
+        char what[16];
+        sprintf(what, "quantile p%u", pct[p]);
+        ok &= check(what, Quantile::get(&s, pct[p]), v, SKETCH_WIDTH);
+    }
+
+    return ok;
+}
+
+static bool used(const char* alloc, const char* step, bool quiet=false)
+{
+    struct pico_fsstat_t st;
+    pico_fsstat(&st);
+    uint32_t want = lfs_fs_size();
+
+    if(quiet && st.blocks_used==want)
+        return true;
+
+    char what[32];
+    sprintf(what, "%s %s", alloc, step);
+    return check(what, st.blocks_used, want, 0);
+}
+
+static void put(const char* name, int flags, uint32_t bytes)
+{
+    static uint8_t buf[6000];
+    memset(buf, 0x5a, sizeof(buf));
+
+    int f = pico_open(name, flags);
+    pico_write(f, buf, bytes < sizeof(buf) ? bytes : sizeof(buf));
+    pico_close(f);
+}
+
+// every step ends with its files closed or synced, the allocator count is
+// exact then
+//
+static bool fsused(bool bitmap)
+{
+    const char* alloc = bitmap ? "bitmap" : "lookahead";
+    bool ok = true;
+
+    pico_cfg.alloc_bitmap = bitmap;
+    sim_reset();
+    flash_sim_reset();
+    pico_mount(true);
+
+    put("a", LFS_O_WRONLY | LFS_O_CREAT, 5000);             // partial last block
+    ok &= used(alloc, "append");
+
+    int f = pico_open("a", LFS_O_WRONLY | LFS_O_APPEND);    // copies the last block
+    uint8_t x[100] = {0};
+    pico_write(f, x, sizeof(x));
+    pico_fflush(f);
+    ok &= used(alloc, "sync");
+    pico_close(f);
+
+    put("b", LFS_O_WRONLY | LFS_O_CREAT, 9000);
+    pico_rename("b", "a");                                  // over a
+    ok &= used(alloc, "rename");
+
+    put("a", LFS_O_WRONLY | LFS_O_TRUNC, 300);              // inline
+    put("c", LFS_O_WRONLY | LFS_O_CREAT, 6000);
+    f = pico_open("c", LFS_O_WRONLY);
+    pico_truncate(f, 4500);
+    pico_close(f);
+    ok &= used(alloc, "truncate");
+
+    pico_remove("c");
+    ok &= used(alloc, "remove");
+
+    pico_mkdir("d");
+    put("d/e", LFS_O_WRONLY | LFS_O_CREAT, 6000);
+    pico_remove("d/e");
+    pico_remove("d");
+    ok &= used(alloc, "rmdir");
+
+    pico_unmount();
+    pico_mount(false);
+    ok &= used(alloc, "remount");
+
+    // appends, syncs, truncating rewrites and removes on three open files
+    const char* names[3] = { "a", "d/b", "d/c" };
+    int files[3] = { -1, -1, -1 };
+    uint32_t bad = 0;
+    pico_mkdir("d");
+    seed = 1;
+
+    for(uint32_t i=0; i<FS_OPS; i++){
+        uint32_t k = rnd(3), op = rnd(10);
+        uint8_t y[3000];
+        memset(y, 0xa5, sizeof(y));
+
+        if(files[k] < 0)
+            files[k] = pico_open(names[k], LFS_O_WRONLY | LFS_O_CREAT | LFS_O_APPEND);
+
+        if(op < 6){
+            pico_write(files[k], y, rnd(sizeof(y)));
+        }
+        else if(op < 8){
+            pico_fflush(files[k]);
+        }
+        else{
+            pico_close(files[k]);
+            files[k] = -1;
+
+            if(op == 8)
+                put(names[k], LFS_O_WRONLY | LFS_O_TRUNC, rnd(600));
+            else
+                pico_remove(names[k]);
+        }
+
+        struct pico_fsstat_t st;
+        pico_fsstat(&st);
+
+        for(uint8_t j=0; j<3; j++){
+            if(st.blocks_used > FS_FILL && files[j] >= 0){
+                pico_close(files[j]);
+                files[j] = -1;
+            }
+
+            if(st.blocks_used > FS_FILL)
+                pico_remove(names[j]);
+            else if(files[j] >= 0)
+                pico_fflush(files[j]);
+        }
+
+        char step[24];
+        sprintf(step, "random %u", i);
+        bad += !used(alloc, step, true);
+    }
+
+    pico_unmount();
+    return check(bitmap ? "bitmap random" : "lookahead random", bad, 0, 0) && ok;
+}
+
+int main(int argc, char** argv)
+{
+    if(argc == 2 && strcmp(argv[1], "quantile") == 0)
+        return quantile() ? 0 : 1;
+
+    if(argc == 2 && strcmp(argv[1], "fsused") == 0)
+        return fsused(false) & fsused(true) ? 0 : 1;
+
+    printf("usage: picolog_test quantile | fsused\n");
+    return 1;
+}
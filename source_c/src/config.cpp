@@ -1,10 +1,17 @@
+#include <stddef.h>
 #include "config.h"
 
 struct Conf Config::cfg = {                     // default config
     .dateYMD = 20220101,
     .dateHMS = 0,
     .interval = 15,
-    .append = false             
+    .append = false,
+    .sync = 1,
+    .batch = 256,
+    .maxAge = 3600,
+    .store = 1,
+    .ring = 0,
+    .segment = 16
 };
 
 uint8_t Config::init()
@@ -24,25 +31,33 @@ uint8_t Config::init()
     return err;
 }
 
+// file system is mounted by Sample::init() for the whole session, older
+// firmware wrote a shorter Conf, it is read over the defaults so the fields
+// added since keep them, except store, a Conf without it stays on the data
+// file where its samples are
+//
 uint8_t Config::getConfig()
 {
     uint8_t err = FLASH_OK;
+    int file = pico_open(CONFIG_FILE_NAME, LFS_O_RDONLY);
 
-    if(pico_mount(false) != LFS_ERR_OK){
-        err = FLASH_MOUNT_ERROR;
-    }
-    else{
-        int file = pico_open(CONFIG_FILE_NAME, LFS_O_RDONLY);
+    if(file >= 0){
+        lfs_soff_t n = pico_size(file);
+        n = n < (lfs_soff_t)sizeof(Conf) ? n : sizeof(Conf);
 
-        if(file>=0 && pico_size(file)==sizeof(Conf)){
-            pico_read(file, &cfg, sizeof(Conf));
-            pico_close(file);
+        if(n >= (lfs_soff_t)offsetof(Conf, sync)){      // first release
+            pico_read(file, &cfg, n);
+
+            if(n < (lfs_soff_t)offsetof(Conf, ring))    // before the sample log
+                cfg.store = 0;
         }
-        else{
+        else
             err = FLASH_FILE_ERROR;
-        }
 
-        pico_unmount();
+        pico_close(file);
+    }
+    else{
+        err = FLASH_FILE_ERROR;
     }
 
     return err;
@@ -52,32 +67,24 @@ uint8_t Config::setConfig()
 {
     uint8_t err = FLASH_OK;
 
-    if(pico_mount(false) != LFS_ERR_OK){
-        err = FLASH_MOUNT_ERROR;
-    }
-    else{
-        struct pico_fsstat_t stat;
-        pico_fsstat(&stat);
-        uint16_t blocksFree = stat.block_count - stat.blocks_used;
-
-        if(blocksFree >= BLOCKS_MIN_FREE){
-            int file = pico_open(CONFIG_FILE_NAME, LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC);
-
-            if(file >= 0){
-                pico_write(file, &cfg, sizeof(Conf));
-                pico_close(file);
-            }
-            else{
-                err = FLASH_FILE_ERROR;
-            }
+    struct pico_fsstat_t stat;
+    pico_fsstat(&stat);
+    uint16_t blocksFree = stat.block_count - stat.blocks_used;
+
+    if(blocksFree >= BLOCKS_MIN_FREE){
+        int file = pico_open(CONFIG_FILE_NAME, LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC);
+
+        if(file >= 0){
+            pico_write(file, &cfg, sizeof(Conf));
+            pico_close(file);
         }
         else{
-            err = FLASH_FULL_ERROR;
+            err = FLASH_FILE_ERROR;
         }
-
-        pico_unmount();
     }
-
+    else{
+        err = FLASH_FULL_ERROR;
+    }
 
     return err;
 }
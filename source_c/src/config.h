@@ -17,7 +17,13 @@ typedef struct Conf{
     uint32_t dateHMS;                       //                hhmmss
     uint32_t interval;                      //        interval in seconds
     bool append;                            // append samples
-}Conf;
+    uint32_t sync;                          // buffer flushes per file sync
+    uint32_t batch;                         // RAM batch in bytes, 256..4096
+    uint32_t maxAge;                        // samples not saved to flash, max age in seconds
+    uint32_t store;                         // 0 data file in lfs, 1 raw flash sample log
+    uint32_t ring;                          // 1 drop oldest log sector or data segment when full
+    uint32_t segment;                       // data segment size in KB, 4..256
+}Conf;                                      // new fields go last, see getConfig()
 
 class Config
 {
@@ -26,11 +32,23 @@ class Config
         static void setDateYMD(uint32_t v) { cfg.dateYMD = v; }
         static void setDateHMS(uint32_t v) { cfg.dateHMS = v; }
         static void setInterval(uint32_t v) { cfg.interval = v; }
+        static void setSync(uint32_t v) { cfg.sync = v; }
+        static void setBatch(uint32_t v) { cfg.batch = v; }
+        static void setMaxAge(uint32_t v) { cfg.maxAge = v; }
+        static void setStore(uint32_t v) { cfg.store = v; }
+        static void setRing(uint32_t v) { cfg.ring = v; }
+        static void setSegment(uint32_t v) { cfg.segment = v; }
         static void setAppend(bool v) { cfg.append = v; }
 
         static uint32_t getDateYMD() { return cfg.dateYMD; }
         static uint32_t getDateHMS() { return cfg.dateHMS; }
         static uint32_t getInterval() { return cfg.interval; }
+        static uint32_t getSync() { return cfg.sync; }
+        static uint32_t getBatch() { return cfg.batch; }
+        static uint32_t getMaxAge() { return cfg.maxAge; }
+        static uint32_t getStore() { return cfg.store; }
+        static uint32_t getRing() { return cfg.ring; }
+        static uint32_t getSegment() { return cfg.segment; }
         static bool getAppend() { return cfg.append; }
 
         static void save() { setConfig(); }
@@ -9,6 +9,13 @@
 
 lfs_t lfs;
 
+#ifdef LFS_STATS
+struct lfs_stats lfs_stats;
+#define LFS_STAT_INC(field) (lfs_stats.field++)
+#else
+#define LFS_STAT_INC(field)
+#endif
+
 #define LFS_BLOCK_NULL ((lfs_block_t)-1)
 #define LFS_BLOCK_INLINE ((lfs_block_t)-2)
 
@@ -75,6 +82,7 @@ static int lfs_bd_read(const lfs_cache_t* pcache, lfs_cache_t* rcache, lfs_size_
             diff = lfs_aligndown(diff, lfs.cfg->read_size);
             int err = lfs.cfg->read(block, off, data, diff);
             if (err) {
+                lfs.free.erred = true;
                 return err;
             }
 
@@ -94,6 +102,7 @@ static int lfs_bd_read(const lfs_cache_t* pcache, lfs_cache_t* rcache, lfs_size_
         int err = lfs.cfg->read(rcache->block, rcache->off, rcache->buffer, rcache->size);
         LFS_ASSERT(err <= 0);
         if (err) {
+            lfs.free.erred = true;
             return err;
         }
     }
@@ -138,6 +147,7 @@ static int lfs_bd_flush(lfs_cache_t* pcache, lfs_cache_t* rcache, bool validate)
         int err = lfs.cfg->prog(pcache->block, pcache->off, pcache->buffer, diff);
         LFS_ASSERT(err <= 0);
         if (err) {
+            lfs.free.erred = true;
             return err;
         }
 
@@ -151,6 +161,7 @@ static int lfs_bd_flush(lfs_cache_t* pcache, lfs_cache_t* rcache, bool validate)
             }
 
             if (res != LFS_CMP_EQ) {
+                lfs.free.erred = true;
                 return LFS_ERR_CORRUPT;
             }
         }
@@ -218,6 +229,9 @@ static int lfs_bd_erase(lfs_block_t block) {
     LFS_ASSERT(block < lfs.cfg->block_count);
     int err = lfs.cfg->erase(block);
     LFS_ASSERT(err <= 0);
+    if (err) {
+        lfs.free.erred = true;
+    }
     return err;
 }
 #endif
@@ -448,9 +462,14 @@ static int lfs_fs_forceconsistency(void);
 static int lfs_dir_rawrewind(lfs_dir_t* dir);
 
 static lfs_ssize_t lfs_file_rawread(lfs_file_t* file, void* buffer, lfs_size_t size);
+static lfs_ssize_t lfs_file_rawlocate(lfs_file_t* file, lfs_block_t* block, lfs_off_t* off,
+                                      lfs_size_t size);
 static int lfs_file_rawclose(lfs_file_t* file);
 static lfs_soff_t lfs_file_rawsize(lfs_file_t* file);
 
+static int lfs_ctz_traverse(const lfs_cache_t* pcache, lfs_cache_t* rcache, lfs_block_t head,
+                            lfs_size_t size, int (*cb)(void*, lfs_block_t), void* data);
+
 static lfs_ssize_t lfs_fs_rawsize(void);
 static int lfs_fs_rawtraverse(int (*cb)(void* data, lfs_block_t block), void* data,
                               bool includeorphans);
@@ -475,18 +494,211 @@ static int lfs_alloc_lookahead(void *p, lfs_block_t block) {
 // indicate allocated blocks have been committed into the filesystem, this
 // is to prevent blocks from being garbage collected in the middle of a
 // commit operation
-static void lfs_alloc_ack(void) { lfs.free.ack = lfs.cfg->block_count; }
+static void lfs_alloc_ack(void) {
+    lfs.free.ack = lfs.cfg->block_count;
+
+    if (lfs.cfg->alloc_bitmap) {
+        memset(lfs.free.inflight, 0, lfs_alignup(lfs.cfg->block_count, 32) / 8);
+    }
+}
 
 // drop the lookahead buffer, this is done during mounting and failed
 // traversals in order to avoid invalid lookahead state
 static void lfs_alloc_drop(void) {
     lfs.free.size = 0;
     lfs.free.i = 0;
+    lfs.free.used = -1;
+    lfs.free.valid = false;
     lfs_alloc_ack();
 }
 
+// track the number of blocks in use, a negative count is unknown and
+// is recounted by the next lfs_fs_used
+static void lfs_alloc_used(lfs_ssize_t diff) {
+    if (lfs.free.used >= 0) {
+        lfs.free.used += diff;
+    }
+}
+
+static void lfs_alloc_unknown(void) { lfs.free.used = -1; }
+
+// a block is no longer referenced once the current operation completes,
+// it stays pending until the next safe point, with alloc_bitmap it is kept
+// in use until then, a lookahead recount leaves it out
+static void lfs_alloc_free(lfs_block_t block) {
+    lfs_alloc_used(-1);
+    lfs.free.pending[block / 32] |= 1U << (block % 32);
+}
+
+#ifndef LFS_READONLY
+static int lfs_alloc_free_ctz(void *p, lfs_block_t block) {
+    (void)p;
+    lfs_alloc_free(block);
+    return LFS_ERR_OK;
+}
+
+// open readers keep walking the skip list they loaded, even after a commit
+// of another handle replaced blocks of it
+static int lfs_alloc_readers(int (*cb)(void*, lfs_block_t)) {
+    for (lfs_file_t* f = (lfs_file_t*)lfs.mlist; f; f = f->next) {
+        if (f->type == LFS_TYPE_REG && (f->flags & LFS_O_RDONLY) &&
+                !(f->flags & LFS_F_INLINE)) {
+            int err = lfs_ctz_traverse(NULL, &lfs.rcache, f->ctz.head, f->ctz.size, cb, NULL);
+            if (err) {
+                return err;
+            }
+        }
+    }
+
+    return LFS_ERR_OK;
+}
+
+// a pending block an open reader still walks is marked by clearing it
+static int lfs_alloc_keep(void *p, lfs_block_t block) {
+    (void)p;
+    if (block < lfs.cfg->block_count &&
+            (lfs.free.pending[block / 32] & (1U << (block % 32)))) {
+        lfs.free.buffer[block / 32] &= ~(1U << (block % 32));
+    }
+
+    return LFS_ERR_OK;
+}
+
+// called at the end of top level operations, frees pending blocks when no
+// open file may still reference them, blocks of open readers stay pending,
+// a device error on the way leaves them in use until the bitmap is rebuilt
+static void lfs_alloc_release(void) {
+    for (lfs_file_t* f = (lfs_file_t*)lfs.mlist; f; f = f->next) {
+        if (f->type == LFS_TYPE_REG &&
+                (f->flags & (LFS_F_DIRTY | LFS_F_WRITING | LFS_F_ERRED))) {
+            return;
+        }
+    }
+
+    const lfs_size_t words = lfs_alignup(lfs.cfg->block_count, 32) / 32;
+    if (lfs.cfg->alloc_bitmap && lfs.free.valid && !lfs.free.erred) {
+        int err = lfs_alloc_readers(lfs_alloc_keep);
+        for (lfs_size_t i = 0; i < words; i++) {
+            if (err) {
+                // keep all of them pending, retried at the next safe point
+                lfs.free.buffer[i] |= lfs.free.pending[i];
+                continue;
+            }
+
+            // frees released blocks and sets the kept ones in use again
+            uint32_t kept = lfs.free.pending[i] & ~lfs.free.buffer[i];
+            lfs.free.buffer[i] ^= lfs.free.pending[i];
+            lfs.free.pending[i] = kept;
+        }
+
+        if (err) {
+            return;
+        }
+    } else {
+        memset(lfs.free.pending, 0, words * 4);
+    }
+
+    lfs.free.erred = false;
+}
+
+static int lfs_alloc_mark(void *p, lfs_block_t block) {
+    (void)p;
+    if (block < lfs.cfg->block_count) {
+        lfs.free.buffer[block / 32] |= 1U << (block % 32);
+    }
+
+    return LFS_ERR_OK;
+}
+
+// build the free bitmap from the filesystem, blocks allocated since the
+// last ack are not reachable yet and are kept in use, as are blocks of
+// open readers
+static int lfs_alloc_rebuild(void) {
+    const lfs_size_t words = lfs_alignup(lfs.cfg->block_count, 32) / 32;
+    memset(lfs.free.buffer, 0, words * 4);
+
+    int err = lfs_fs_rawtraverse(lfs_alloc_mark, NULL, true);
+    if (!err) {
+        err = lfs_alloc_readers(lfs_alloc_mark);
+    }
+    if (err) {
+        lfs.free.valid = false;
+        return err;
+    }
+
+    // as the lookahead recount, pending blocks are not counted and an
+    // unknown count stays unknown
+    lfs_ssize_t used = 0;
+    for (lfs_size_t i = 0; i < words; i++) {
+        lfs.free.buffer[i] |= lfs.free.inflight[i];
+        lfs.free.pending[i] &= lfs.free.buffer[i];
+        used += lfs_popc(lfs.free.buffer[i] & ~lfs.free.pending[i]);
+    }
+
+    if (lfs.free.used >= 0) {
+        lfs.free.used = used;
+    }
+
+    lfs.free.valid = true;
+    return LFS_ERR_OK;
+}
+
+// next fit search from the last allocation, skips full words
+static bool lfs_alloc_find(lfs_block_t* block) {
+    lfs_block_t b = lfs.free.off;
+
+    for (lfs_size_t left = lfs.cfg->block_count; left > 0;) {
+        if (b % 32 == 0 && left >= 32 && b + 32 <= lfs.cfg->block_count &&
+                lfs.free.buffer[b / 32] == 0xffffffff) {
+            b += 32;
+            left -= 32;
+        } else if (!(lfs.free.buffer[b / 32] & (1U << (b % 32)))) {
+            *block = b;
+            return true;
+        } else {
+            b += 1;
+            left -= 1;
+        }
+
+        if (b >= lfs.cfg->block_count) {
+            b = 0;
+        }
+    }
+
+    return false;
+}
+
+static int lfs_alloc_bitmap(lfs_block_t* block) {
+    if (!lfs.free.valid || !lfs_alloc_find(block)) {
+        // device full as far as known, look for unreferenced blocks
+        int err = lfs_alloc_rebuild();
+        if (err) {
+            return err;
+        }
+
+        if (!lfs_alloc_find(block)) {
+            LFS_ERROR("No more free space %" PRIu32, lfs.cfg->block_count);
+            lfs.free.erred = true;
+            return LFS_ERR_NOSPC;
+        }
+    }
+
+    lfs.free.buffer[*block / 32] |= 1U << (*block % 32);
+    lfs.free.inflight[*block / 32] |= 1U << (*block % 32);
+    lfs.free.off = (*block + 1) % lfs.cfg->block_count;
+    lfs_alloc_used(+1);
+    return LFS_ERR_OK;
+}
+#endif
+
 #ifndef LFS_READONLY
 static int lfs_alloc(lfs_block_t* block) {
+    LFS_STAT_INC(allocs);
+
+    if (lfs.cfg->alloc_bitmap) {
+        return lfs_alloc_bitmap(block);
+    }
+
     while (true) {
         while (lfs.free.i != lfs.free.size) {
             lfs_block_t off = lfs.free.i;
@@ -496,6 +708,8 @@ static int lfs_alloc(lfs_block_t* block) {
             if (!(lfs.free.buffer[off / 32] & (1U << (off % 32)))) {
                 // found a free block
                 *block = (lfs.free.off + off) % lfs.cfg->block_count;
+                lfs.free.pending[*block / 32] &= ~(1U << (*block % 32));
+                lfs_alloc_used(+1);
 
                 // eagerly find next off so an alloc ack can
                 // discredit old lookahead blocks
@@ -526,6 +740,20 @@ static int lfs_alloc(lfs_block_t* block) {
             lfs_alloc_drop();
             return err;
         }
+
+        // lookahead covers the whole device, reconcile the count of blocks in
+        // use, blocks still on disk but freed by the current operation are
+        // not, an unknown count may include dropped files and stays unknown
+        if (lfs.free.size == lfs.cfg->block_count && lfs.free.used >= 0) {
+            lfs.free.used = 0;
+            for (lfs_block_t off = 0; off < lfs.free.size; off++) {
+                lfs_block_t b = (lfs.free.off + off) % lfs.cfg->block_count;
+                if ((lfs.free.buffer[off / 32] & (1U << (off % 32))) &&
+                        !(lfs.free.pending[b / 32] & (1U << (b % 32)))) {
+                    lfs.free.used += 1;
+                }
+            }
+        }
     }
 }
 #endif
@@ -1252,6 +1480,8 @@ static int lfs_dir_commitattr(struct lfs_commit* commit, lfs_tag_t tag, const vo
 
 #ifndef LFS_READONLY
 static int lfs_dir_commitcrc(struct lfs_commit* commit) {
+    LFS_STAT_INC(commits);
+
     // align to program units
     const lfs_off_t end = lfs_alignup(commit->off + 2 * sizeof(uint32_t), lfs.cfg->prog_size);
 
@@ -1393,6 +1623,9 @@ static int lfs_dir_alloc(lfs_mdir_t* dir) {
 
 #ifndef LFS_READONLY
 static int lfs_dir_drop(lfs_mdir_t* dir, lfs_mdir_t* tail) {
+    // dropped pair is freed, may be part of a bigger chain
+    lfs_alloc_unknown();
+
     // steal state
     int err = lfs_dir_getgstate(tail, &lfs.gdelta);
     if (err) {
@@ -1472,6 +1705,8 @@ static int lfs_dir_commit_commit(void *p, lfs_tag_t tag, const void *buffer) {
 #ifndef LFS_READONLY
 static int lfs_dir_compact(lfs_mdir_t* dir, const struct lfs_mattr* attrs, int attrcount,
                            lfs_mdir_t* source, uint16_t begin, uint16_t end) {
+    LFS_STAT_INC(compacts);
+
     // save some state in case block is bad
     const lfs_block_t oldpair[2] = {dir->pair[0], dir->pair[1]};
     bool relocated = false;
@@ -1682,11 +1917,17 @@ relocate:
         }
 
         // relocate half of pair
+        lfs_block_t oldblock = dir->pair[1];
         int err = lfs_alloc(&dir->pair[1]);
         if (err && (err != LFS_ERR_NOSPC || !tired)) {
             return err;
         }
 
+        if (!err) {
+            // old half of pair is released
+            lfs_alloc_free(oldblock);
+        }
+
         tired = false;
         continue;
     }
@@ -1982,6 +2223,7 @@ static int lfs_rawmkdir(const char* path) {
         return err;
     }
 
+    lfs_alloc_release();
     return LFS_ERR_OK;
 }
 #endif
@@ -2228,6 +2470,9 @@ static int lfs_ctz_extend(lfs_cache_t* pcache, lfs_cache_t* rcache, lfs_block_t
                     }
                 }
 
+                // the copied block is released once the new head is committed
+                lfs_alloc_free(head);
+
                 *block = nblock;
                 *off = noff;
                 return LFS_ERR_OK;
@@ -2268,6 +2513,7 @@ relocate:
 
         // just clear cache and try a new block
         lfs_cache_drop(pcache);
+        lfs_alloc_free(nblock);
     }
 }
 #endif
@@ -2387,6 +2633,7 @@ static int lfs_file_rawopencfg(lfs_file_t* file, const char* path, int flags,
         // truncate if requested
         tag = LFS_MKTAG(LFS_TYPE_INLINESTRUCT, file->id, 0);
         file->flags |= LFS_F_DIRTY;
+        lfs_alloc_unknown();
 #endif
     } else {
         // try to load what's on disk, if it's inlined we'll fix it later
@@ -2490,6 +2737,13 @@ static int lfs_file_rawclose(lfs_file_t* file) {
     // remove from list of mdirs
     lfs_mlist_remove((struct lfs_mlist*)file);
 
+#ifndef LFS_READONLY
+    if (file->flags & LFS_F_ERRED) {
+        // its old blocks may still be referenced on disk
+        lfs.free.erred = true;
+    }
+#endif
+
     // clean up memory
     if (!file->file_cfg->buffer) {
         lfs_free(file->cache.buffer);
@@ -2551,6 +2805,11 @@ static int lfs_file_relocate(lfs_file_t* file) {
         file->cache.size = lfs.pcache.size;
         lfs_cache_zero(&lfs.pcache);
 
+        if (!(file->flags & LFS_F_INLINE)) {
+            // old block is not referenced anymore
+            lfs_alloc_free(file->block);
+        }
+
         file->block = nblock;
         file->flags |= LFS_F_WRITING;
         return LFS_ERR_OK;
@@ -2560,6 +2819,7 @@ relocate:
 
         // just clear cache and try a new block
         lfs_cache_drop(&lfs.pcache);
+        lfs_alloc_free(nblock);
     }
 }
 #endif
@@ -2707,6 +2967,7 @@ static int lfs_file_rawsync(lfs_file_t* file) {
         file->flags &= ~LFS_F_DIRTY;
     }
 
+    lfs_alloc_release();
     return LFS_ERR_OK;
 }
 #endif
@@ -2778,6 +3039,41 @@ static lfs_ssize_t lfs_file_rawread(lfs_file_t* file, void* buffer, lfs_size_t s
     return size;
 }
 
+static lfs_ssize_t lfs_file_rawlocate(lfs_file_t* file, lfs_block_t* block, lfs_off_t* off,
+                                      lfs_size_t size) {
+    LFS_ASSERT((file->flags & LFS_O_RDONLY) == LFS_O_RDONLY);
+
+    if (file->flags & (LFS_F_INLINE | LFS_F_WRITING)) {
+        // data in the metadata pair or the file cache
+        return 0;
+    }
+
+    if (file->pos >= file->ctz.size) {
+        // eof if past end
+        return 0;
+    }
+
+    if (!(file->flags & LFS_F_READING) || file->off == lfs.cfg->block_size) {
+        int err = lfs_ctz_find(NULL, &file->cache, file->ctz.head, file->ctz.size,
+                               file->pos, &file->block, &file->off);
+        if (err) {
+            return err;
+        }
+
+        file->flags |= LFS_F_READING;
+    }
+
+    // as much as is in the current block
+    lfs_size_t diff = lfs_min(lfs_min(size, file->ctz.size - file->pos),
+                              lfs.cfg->block_size - file->off);
+    *block = file->block;
+    *off = file->off;
+
+    file->pos += diff;
+    file->off += diff;
+    return diff;
+}
+
 #ifndef LFS_READONLY
 static lfs_ssize_t lfs_file_rawwrite(lfs_file_t* file, const void* buffer, lfs_size_t size) {
     LFS_ASSERT((file->flags & LFS_O_WRONLY) == LFS_O_WRONLY);
@@ -2948,6 +3244,9 @@ static int lfs_file_rawtruncate(lfs_file_t* file, lfs_off_t size) {
             return err;
         }
 
+        // released part of the skip list is not tracked
+        lfs_alloc_unknown();
+
         // lookup new head in ctz skip list
         err = lfs_ctz_find(NULL, &file->cache, file->ctz.head, file->ctz.size, size, &file->block,
                            &file->off);
@@ -3038,6 +3337,21 @@ static int lfs_rawremove(const char* path) {
         return (tag < 0) ? (int)tag : LFS_ERR_INVAL;
     }
 
+    // blocks released by removing a file
+    struct lfs_ctz ctz = {.size = 0};
+    if (lfs_tag_type3(tag) == LFS_TYPE_REG) {
+        lfs_stag_t res = lfs_dir_get(&cwd, LFS_MKTAG(0x700, 0x3ff, 0),
+                                     LFS_MKTAG(LFS_TYPE_STRUCT, lfs_tag_id(tag), sizeof(ctz)), &ctz);
+        if (res < 0) {
+            return (int)res;
+        }
+        lfs_ctz_fromle32(&ctz);
+
+        if (lfs_tag_type3(res) != LFS_TYPE_CTZSTRUCT) {
+            ctz.size = 0;
+        }
+    }
+
     struct lfs_mlist dir;
     dir.next = lfs.mlist;
     if (lfs_tag_type3(tag) == LFS_TYPE_DIR) {
@@ -3080,6 +3394,17 @@ static int lfs_rawremove(const char* path) {
     }
 
     lfs.mlist = dir.next;
+    if (ctz.size > 0 && lfs.cfg->alloc_bitmap) {
+        // skip list is still intact on disk
+        err = lfs_ctz_traverse(NULL, &lfs.rcache, ctz.head, ctz.size, lfs_alloc_free_ctz, NULL);
+        if (err) {
+            return err;
+        }
+    } else if (ctz.size > 0) {
+        lfs_off_t off = ctz.size - 1;
+        lfs_alloc_used(-(lfs_ctz_index(&off) + 1));
+    }
+
     if (lfs_tag_type3(tag) == LFS_TYPE_DIR) {
         // fix orphan
         err = lfs_fs_preporphans(-1);
@@ -3098,6 +3423,7 @@ static int lfs_rawremove(const char* path) {
         }
     }
 
+    lfs_alloc_release();
     return LFS_ERR_OK;
 }
 #endif
@@ -3200,6 +3526,11 @@ static int lfs_rawrename(const char* oldpath, const char* newpath) {
         return err;
     }
 
+    if (prevtag != LFS_ERR_NOENT) {
+        // overwritten entry is released
+        lfs_alloc_unknown();
+    }
+
     // let commit clean up after move (if we're different! otherwise move
     // logic already fixed it for us)
     if (!samepair && lfs_gstate_hasmove(&lfs.gstate)) {
@@ -3232,6 +3563,7 @@ static int lfs_rawrename(const char* oldpath, const char* newpath) {
         }
     }
 
+    lfs_alloc_release();
     return LFS_ERR_OK;
 }
 #endif
@@ -3363,14 +3695,38 @@ static int lfs_init(const struct lfs_config* cfg) {
     // setup lookahead, must be multiple of 64-bits, 32-bit aligned
     LFS_ASSERT(lfs.cfg->lookahead_size > 0);
     LFS_ASSERT(lfs.cfg->lookahead_size % 8 == 0 && (uintptr_t)lfs.cfg->lookahead_buffer % 4 == 0);
-    if (lfs.cfg->lookahead_buffer) {
-        lfs.free.buffer = lfs.cfg->lookahead_buffer;
-    } else {
-        lfs.free.buffer = lfs_malloc(lfs.cfg->lookahead_size);
+    if (lfs.cfg->alloc_bitmap) {
+        // free, inflight and pending bitmaps of the whole device
+        lfs_size_t bytes = lfs_alignup(lfs.cfg->block_count, 32) / 8;
+        lfs.free.buffer = lfs_malloc(3 * bytes);
         if (!lfs.free.buffer) {
             err = LFS_ERR_NOMEM;
             goto cleanup;
         }
+        memset(lfs.free.buffer, 0, 3 * bytes);
+        lfs.free.inflight = lfs.free.buffer + bytes / 4;
+        lfs.free.pending = lfs.free.inflight + bytes / 4;
+        lfs.free.valid = false;
+        lfs.free.erred = false;
+    } else {
+        if (lfs.cfg->lookahead_buffer) {
+            lfs.free.buffer = lfs.cfg->lookahead_buffer;
+        } else {
+            lfs.free.buffer = lfs_malloc(lfs.cfg->lookahead_size);
+            if (!lfs.free.buffer) {
+                err = LFS_ERR_NOMEM;
+                goto cleanup;
+            }
+        }
+
+        // blocks freed since the last safe point, kept out of the used count
+        lfs_size_t bytes = lfs_alignup(lfs.cfg->block_count, 32) / 8;
+        lfs.free.pending = lfs_malloc(bytes);
+        if (!lfs.free.pending) {
+            err = LFS_ERR_NOMEM;
+            goto cleanup;
+        }
+        memset(lfs.free.pending, 0, bytes);
     }
 
     // check that the size limits are sane
@@ -3420,10 +3776,14 @@ static int lfs_deinit(void) {
         lfs_free(lfs.pcache.buffer);
     }
 
-    if (!lfs.cfg->lookahead_buffer) {
+    if (!lfs.cfg->lookahead_buffer || lfs.cfg->alloc_bitmap) {
         lfs_free(lfs.free.buffer);
     }
 
+    if (!lfs.cfg->alloc_bitmap) {
+        lfs_free(lfs.free.pending);
+    }
+
     return LFS_ERR_OK;
 }
 
@@ -3445,7 +3805,12 @@ static int lfs_rawformat(const struct lfs_config* cfg) {
     LFS_LOCK;
 
     // create free lookahead
-    memset(lfs.free.buffer, 0, lfs.cfg->lookahead_size);
+    if (lfs.cfg->alloc_bitmap) {
+        memset(lfs.free.buffer, 0, lfs_alignup(lfs.cfg->block_count, 32) / 8);
+        lfs.free.valid = true;
+    } else {
+        memset(lfs.free.buffer, 0, lfs.cfg->lookahead_size);
+    }
     lfs.free.off = 0;
     lfs.free.size = lfs_min(8 * lfs.cfg->lookahead_size, lfs.cfg->block_count);
     lfs.free.i = 0;
@@ -3608,6 +3973,18 @@ static int lfs_rawmount(const struct lfs_config* cfg) {
     // boots, we start the allocator at a random location
     lfs.free.off = lfs.seed % lfs.cfg->block_count;
     lfs_alloc_drop();
+
+#ifndef LFS_READONLY
+    if (lfs.cfg->alloc_bitmap) {
+        // one traversal per mount, retried on first alloc if it fails,
+        // nothing is pending yet, so it counts the blocks in use as well
+        lfs.free.used = 0;
+        if (lfs_alloc_rebuild()) {
+            lfs_alloc_unknown();
+        }
+    }
+#endif
+
     LFS_UNLOCK;
     return LFS_ERR_OK;
 
@@ -3621,6 +3998,8 @@ static int lfs_rawunmount(void) { return lfs_deinit(); }
 
 /// Filesystem filesystem operations ///
 int lfs_fs_rawtraverse(int (*cb)(void* data, lfs_block_t block), void* data, bool includeorphans) {
+    LFS_STAT_INC(traverses);
+
     // iterate over metadata pairs
     lfs_mdir_t dir = {.tail = {0, 1}};
 
@@ -4033,6 +4412,19 @@ static lfs_ssize_t lfs_fs_rawsize(void) {
     return size;
 }
 
+static lfs_ssize_t lfs_fs_rawused(void) {
+    if (lfs.free.used < 0) {
+        lfs_ssize_t res = lfs_fs_rawsize();
+        if (res < 0) {
+            return res;
+        }
+
+        lfs.free.used = res;
+    }
+
+    return lfs.free.used;
+}
+
 /// Public API wrappers ///
 
 // Here we can add tracing/thread safety easily
@@ -4272,6 +4664,21 @@ lfs_ssize_t lfs_file_read(lfs_file_t* file, void* buffer, lfs_size_t size) {
     return res;
 }
 
+lfs_ssize_t lfs_file_locate(lfs_file_t* file, lfs_block_t* block, lfs_off_t* off, lfs_size_t size) {
+    int err = LFS_LOCK;
+    if (err) {
+        return err;
+    }
+    LFS_TRACE("lfs_file_locate(%p, %p, %"PRIu32")", (void*)lfs, (void*)file, size);
+    LFS_ASSERT(lfs_mlist_isopen(lfs.mlist, (struct lfs_mlist*)file));
+
+    lfs_ssize_t res = lfs_file_rawlocate(file, block, off, size);
+
+    LFS_TRACE("lfs_file_locate -> %"PRId32, res);
+    LFS_UNLOCK;
+    return res;
+}
+
 #ifndef LFS_READONLY
 lfs_ssize_t lfs_file_write(lfs_file_t* file, const void* buffer, lfs_size_t size) {
     int err = LFS_LOCK;
@@ -4485,6 +4892,20 @@ lfs_ssize_t lfs_fs_size(void) {
     return res;
 }
 
+lfs_ssize_t lfs_fs_used(void) {
+    int err = LFS_LOCK;
+    if (err) {
+        return err;
+    }
+    LFS_TRACE("lfs_fs_used()");
+
+    lfs_ssize_t res = lfs_fs_rawused();
+
+    LFS_TRACE("lfs_fs_used -> %"PRId32, res);
+    LFS_UNLOCK;
+    return res;
+}
+
 int lfs_fs_traverse(int (*cb)(void*, lfs_block_t), void* data) {
     int err = LFS_LOCK;
     if (err) {
@@ -222,6 +222,13 @@ struct lfs_config {
     // can track 8 blocks. Must be a multiple of 8.
     lfs_size_t lookahead_size;
 
+    // Track free blocks of the whole device in a bitmap instead of the
+    // lookahead window. The bitmap is built by one traversal at mount and
+    // kept up to date on alloc and free, so allocation does not traverse the
+    // filesystem again until the device is full. Costs 3 * block_count / 8
+    // bytes of RAM, lookahead_size and lookahead_buffer are not used.
+    bool alloc_bitmap;
+
     // Optional statically allocated read buffer. Must be cache_size.
     // By default lfs_malloc is used to allocate this buffer.
     void *read_buffer;
@@ -399,7 +406,12 @@ typedef struct lfs {
         lfs_block_t size;
         lfs_block_t i;
         lfs_block_t ack;
+        lfs_ssize_t used;
         uint32_t *buffer;
+        uint32_t *pending;      // freed, released at next safe point
+        uint32_t *inflight;     // alloc_bitmap, allocated since last ack
+        bool valid;             //               buffer matches the device
+        bool erred;             //               device error, drop pending
     } free;
 
     const struct lfs_config* cfg;
@@ -411,6 +423,18 @@ typedef struct lfs {
 
 extern lfs_t lfs;
 
+#ifdef LFS_STATS
+// Operation counters for benchmarking, never reset by the littlefs
+struct lfs_stats {
+    uint32_t commits;       // metadata commits
+    uint32_t compacts;      // metadata compactions
+    uint32_t traverses;     // filesystem traversals
+    uint32_t allocs;        // allocated blocks
+};
+
+extern struct lfs_stats lfs_stats;
+#endif
+
 /// Filesystem functions ///
 
 #ifndef LFS_READONLY
@@ -544,6 +568,15 @@ int lfs_file_sync(lfs_file_t* file);
 // Returns the number of bytes read, or a negative error code on failure.
 lfs_ssize_t lfs_file_read(lfs_file_t* file, void* buffer, lfs_size_t size);
 
+// Locate data of file on the block device without reading it
+//
+// Takes up to size bytes at the file position that are contiguous in one
+// block, returns their block and offset and moves the position past them.
+// Inline files and files with pending writes cannot be located, 0 is
+// returned and lfs_file_read must be used.
+// Returns the number of bytes located, or a negative error code on failure.
+lfs_ssize_t lfs_file_locate(lfs_file_t* file, lfs_block_t* block, lfs_off_t* off, lfs_size_t size);
+
 #ifndef LFS_READONLY
 // Write data to file
 //
@@ -644,6 +677,18 @@ int lfs_dir_rewind(lfs_dir_t* dir);
 // Returns the number of allocated blocks, or a negative error code on failure.
 lfs_ssize_t lfs_fs_size(void);
 
+// Finds the number of allocated blocks without traversing the filesystem
+//
+// The count is kept by the block allocator, reconciled whenever the lookahead
+// covers the whole device and adjusted on alloc, relocate and remove. Only
+// after mount and operations it can't track (truncate, rename over, directory
+// removal) the filesystem is traversed once.
+//
+// Note: Result is best effort, like lfs_fs_size.
+//
+// Returns the number of allocated blocks, or a negative error code on failure.
+lfs_ssize_t lfs_fs_used(void);
+
 // Traverse through all blocks in use by the filesystem
 //
 // The provided callback will be called with each block address that is
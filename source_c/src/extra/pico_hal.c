@@ -21,6 +21,14 @@
 
 #define FS_SIZE (256 * 1024)
 
+#ifndef LOG_SIZE
+#define LOG_SIZE (1024 * 1024)  // raw sample log region in front of the file system,
+#endif                          // reserved whichever store is set
+
+#ifndef FS_ALLOC_BITMAP
+#define FS_ALLOC_BITMAP 0   // 1 whole device free bitmap instead of lookahead window
+#endif
+
 static int pico_hal_read(lfs_block_t block, lfs_off_t off, void* buffer, lfs_size_t size);
 static int pico_hal_prog(lfs_block_t block, lfs_off_t off, const void* buffer, lfs_size_t size);
 static int pico_hal_erase(lfs_block_t block);
@@ -46,6 +54,7 @@ struct lfs_config pico_cfg = {
     .block_count = FS_SIZE / FLASH_SECTOR_SIZE,
     .cache_size = FLASH_SECTOR_SIZE / 4,
     .lookahead_size = 32,
+    .alloc_bitmap = FS_ALLOC_BITMAP,
     .block_cycles = 500};
 
 // Pico specific hardware abstraction functions
@@ -53,17 +62,22 @@ struct lfs_config pico_cfg = {
 // file system offset in flash
 const char* FS_BASE = (char*)(PICO_FLASH_SIZE_BYTES - FS_SIZE);
 
+// sample log offset in flash, right below the file system
+const char* LOG_BASE = (char*)(PICO_FLASH_SIZE_BYTES - FS_SIZE - LOG_SIZE);
+
 static int pico_hal_read(lfs_block_t block, lfs_off_t off, void* buffer, lfs_size_t size) {
     assert(block < pico_cfg.block_count);
     assert(off + size <= pico_cfg.block_size);
-    // read flash via XIP mapped space
-    memcpy(buffer, FS_BASE + XIP_NOCACHE_NOALLOC_BASE + (block * pico_cfg.block_size) + off, size);
+    // read flash via the cached XIP window, metadata that mount and lookups
+    // read again hits the cache instead of QSPI
+    memcpy(buffer, FS_BASE + XIP_BASE + (block * pico_cfg.block_size) + off, size);
     return LFS_ERR_OK;
 }
 
 static int pico_hal_prog(lfs_block_t block, lfs_off_t off, const void* buffer, lfs_size_t size) {
     assert(block < pico_cfg.block_count);
-    // program with SDK
+    // program with SDK, flushes the XIP cache before it returns, no stale
+    // lines are read afterwards
     uint32_t p = (uint32_t)FS_BASE + (block * pico_cfg.block_size) + off;
     uint32_t ints = save_and_disable_interrupts();
     flash_range_program(p, buffer, size);
@@ -73,7 +87,7 @@ static int pico_hal_prog(lfs_block_t block, lfs_off_t off, const void* buffer, l
 
 static int pico_hal_erase(lfs_block_t block) {
     assert(block < pico_cfg.block_count);
-    // erase with SDK
+    // erase with SDK, flushes the XIP cache as program
     uint32_t p = (uint32_t)FS_BASE + block * pico_cfg.block_size;
     uint32_t ints = save_and_disable_interrupts();
     flash_range_erase(p, pico_cfg.block_size);
@@ -81,6 +95,41 @@ static int pico_hal_erase(lfs_block_t block) {
     return LFS_ERR_OK;
 }
 
+// raw sample log region, bypasses littlefs, reads and mapped samples use
+// the XIP window that hits cached lines but does not allocate, streamed
+// samples do not evict file system metadata
+
+uint32_t pico_log_size(void) { return LOG_SIZE; }
+
+int pico_log_read(uint32_t off, void* buffer, uint32_t size) {
+    assert(off + size <= LOG_SIZE);
+    memcpy(buffer, LOG_BASE + XIP_NOALLOC_BASE + off, size);
+    return LFS_ERR_OK;
+}
+
+const void* pico_log_map(uint32_t off, uint32_t size) {
+    assert(off + size <= LOG_SIZE);
+    return LOG_BASE + XIP_NOALLOC_BASE + off;
+}
+
+int pico_log_prog(uint32_t off, const void* buffer, uint32_t size) {
+    assert(off % FLASH_PAGE_SIZE == 0 && size % FLASH_PAGE_SIZE == 0);
+    assert(off + size <= LOG_SIZE);
+    uint32_t ints = save_and_disable_interrupts();
+    flash_range_program((uint32_t)LOG_BASE + off, buffer, size);
+    restore_interrupts(ints);
+    return LFS_ERR_OK;
+}
+
+int pico_log_erase(uint32_t off) {
+    assert(off % FLASH_SECTOR_SIZE == 0);
+    assert(off + FLASH_SECTOR_SIZE <= LOG_SIZE);
+    uint32_t ints = save_and_disable_interrupts();
+    flash_range_erase((uint32_t)LOG_BASE + off, FLASH_SECTOR_SIZE);
+    restore_interrupts(ints);
+    return LFS_ERR_OK;
+}
+
 #if LIB_PICO_MULTICORE
 
 static recursive_mutex_t fs_mtx;
@@ -142,6 +191,15 @@ lfs_size_t pico_read(int file, void* buffer, lfs_size_t size) {
     return lfs_file_read((lfs_file_t*)file, buffer, size);
 }
 
+lfs_ssize_t pico_map(int file, const void** data, lfs_size_t size) {
+    lfs_block_t block;
+    lfs_off_t off;
+    lfs_ssize_t n = lfs_file_locate((lfs_file_t*)file, &block, &off, size);
+    if (n > 0)  // streamed once, no cache allocation as the sample log
+        *data = FS_BASE + XIP_NOALLOC_BASE + (block * pico_cfg.block_size) + off;
+    return n;
+}
+
 int pico_rewind(int file) { return lfs_file_rewind((lfs_file_t*)file); }
 
 int pico_unmount(void) { return lfs_unmount(); }
@@ -153,7 +211,8 @@ int pico_rename(const char* oldpath, const char* newpath) { return lfs_rename(ol
 int pico_fsstat(struct pico_fsstat_t* stat) {
     stat->block_count = pico_cfg.block_count;
     stat->block_size = pico_cfg.block_size;
-    stat->blocks_used = lfs_fs_size();
+    stat->blocks_used = lfs_fs_used();
+    stat->log_size = LOG_SIZE;
     return LFS_ERR_OK;
 }
 
@@ -32,6 +32,7 @@ struct pico_fsstat_t {
     lfs_size_t block_size;
     lfs_size_t block_count;
     lfs_size_t blocks_used;
+    uint32_t log_size;      // raw sample log in front, bytes
 };
 
 // Mounts a littlefs
@@ -72,7 +73,8 @@ int pico_close(int file);
 // Return file system statistics
 //
 // Fills out the pico_fsstat_t structure, based on the specified file or
-// directory. Returns a negative error code on failure.
+// directory. blocks_used is tracked by the allocator, see lfs_fs_used.
+// Returns a negative error code on failure.
 int pico_fsstat(struct pico_fsstat_t* stat);
 
 // Change the position of the file to the beginning of the file
@@ -95,6 +97,15 @@ int pico_rename(const char* oldpath, const char* newpath);
 // Returns the number of bytes read, or a negative error code on failure.
 lfs_size_t pico_read(int file, void* buffer, lfs_size_t size);
 
+// Map file data in XIP space instead of reading it
+//
+// Sets data to up to size bytes at the file position that are contiguous
+// in flash and moves the position past them, valid until the file system
+// is written. Returns their number, 0 if the data is not in flash as one
+// piece (inline file, pending writes, end of file), read it with pico_read
+// then, or a negative error code on failure.
+lfs_ssize_t pico_map(int file, const void** data, lfs_size_t size);
+
 // Write data to file
 //
 // Takes a buffer and size indicating the data to write. The file will not
@@ -225,6 +236,35 @@ lfs_soff_t pico_dir_tell(int dir);
 // Returns a negative error code on failure.
 int pico_dir_rewind(int dir);
 
+// Return size of the raw sample log region
+//
+// The region of LOG_SIZE bytes lies in front of the file system and is
+// not managed by littlefs, offsets below are relative to its start.
+uint32_t pico_log_size(void);
+
+// Read from the sample log region via XIP
+//
+// Returns a negative error code on failure.
+int pico_log_read(uint32_t off, void* buffer, uint32_t size);
+
+// Map size bytes of the sample log region in XIP space instead of reading
+//
+// The pointer is valid until the region is programmed or erased.
+const void* pico_log_map(uint32_t off, uint32_t size);
+
+// Program the sample log region
+//
+// Offset and size must be multiples of FLASH_PAGE_SIZE, bytes can only
+// change from 1 to 0. Interrupts are disabled while programming.
+// Returns a negative error code on failure.
+int pico_log_prog(uint32_t off, const void* buffer, uint32_t size);
+
+// Erase one FLASH_SECTOR_SIZE sector of the sample log region
+//
+// Offset must be a multiple of FLASH_SECTOR_SIZE.
+// Returns a negative error code on failure.
+int pico_log_erase(uint32_t off);
+
 // Return pointer to string representation of error code.
 //
 // Returns a negative error code on failure.
@@ -0,0 +1,87 @@
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "pico/stdlib.h"
+#if PICO_STDIO_USB
+#include "pico/stdio_usb.h"
+#endif
+#if PICO_STDIO_UART
+#include "pico/stdio_uart.h"
+#endif
+#include "frame.h"
+#include "store.h"
+
+uint32_t Frame::seq;
+uint32_t Frame::first;
+uint8_t Frame::buf[FRAME_BYTES];
+uint8_t Frame::enc[FRAME_BYTES + FRAME_BYTES / 254 + 2];
+
+// frames are binary, no \n -> \r\n on the stdio drivers while one is written
+//
+static void translate(bool on)
+{
+#if PICO_STDIO_USB
+    stdio_set_translate_crlf(&stdio_usb, on);
+#endif
+#if PICO_STDIO_UART
+    stdio_set_translate_crlf(&stdio_uart, on);
+#endif
+    (void)on;
+}
+
+void Frame::begin(uint32_t first)
+{
+    Frame::seq = 0;
+    Frame::first = first;
+}
+
+void Frame::send(uint8_t type, const void* data, uint16_t len)
+{
+    len = len < FRAME_PAYLOAD ? len : FRAME_PAYLOAD;
+
+    if(seq++ < first)                                       // sent before
+        return;
+
+    uint32_t s = seq - 1;
+    buf[0] = type;
+    memcpy(buf + 1, &s, 4);
+    memcpy(buf + 5, &len, 2);
+    memcpy(buf + FRAME_HEAD_BYTES, data, len);
+
+    uint32_t crc = Store::crc32(0, buf, FRAME_HEAD_BYTES + len);
+    memcpy(buf + FRAME_HEAD_BYTES + len, &crc, 4);
+
+    uint16_t n = cobs(buf, FRAME_HEAD_BYTES + len + 4);
+    enc[n++] = 0;
+
+    fflush(stdout);                                         // printf before
+    translate(false);
+    write(STDOUT_FILENO, enc, n);                           // one bulk transfer per frame
+    translate(true);
+}
+
+// consistent overhead byte stuffing, every 0 is replaced by the distance
+// to the next one, runs of 254 non zero bytes get a code without a 0
+//
+uint16_t Frame::cobs(const uint8_t* data, uint16_t len)
+{
+    uint16_t code = 0, n = 1;
+    enc[0] = 1;
+
+    for(uint16_t i=0; i<len; i++){
+        if(data[i] == 0){
+            code = n++;
+            enc[code] = 1;
+            continue;
+        }
+
+        enc[n++] = data[i];
+
+        if(++enc[code] == 0xff){                            // run full
+            code = n++;
+            enc[code] = 1;
+        }
+    }
+
+    return n;
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdint.h>
+
+#define FRAME_WORDS         64                          // sample words per data frame
+#define FRAME_PAYLOAD       (FRAME_WORDS * 2)
+#define FRAME_HEAD_BYTES    7                           // type, seq, len
+#define FRAME_BYTES         (FRAME_HEAD_BYTES + FRAME_PAYLOAD + 4)
+
+#define FRAME_SESSION       'S'                         // Session, date of the first sample that follows
+#define FRAME_DATA          'D'                         // sample words
+#define FRAME_END           'E'                         // FrameEnd
+
+// binary dump, every frame is
+//   type u8, seq u32, len u16, payload[len], crc32 u32 of all before it
+// little endian as on the Pico, COBS encoded and terminated by a 0 byte, so
+// a receiver resynchronizes at the next 0 after a damaged frame, seq counts
+// from 0 per dump and identifies a frame to request again
+//
+class Frame
+{
+    public:
+        static void begin(uint32_t first);
+        static void send(uint8_t type, const void* data, uint16_t len);
+        static uint32_t getSeq() { return seq; }
+
+    private:
+        static uint32_t seq;                // of next frame
+        static uint32_t first;              // frames before are counted, not sent
+        static uint8_t buf[FRAME_BYTES];
+        static uint8_t enc[FRAME_BYTES + FRAME_BYTES / 254 + 2];    // COBS, one code per 254 bytes, and the 0
+
+        static uint16_t cobs(const uint8_t* data, uint16_t len);
+};
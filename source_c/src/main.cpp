@@ -12,14 +12,31 @@
 #define USE_SLEEP       1           // 0 common delay (~20 mA), 1 sleep (~1.2 mA)
 
 void sample();
-void dump();
+void dump(uint32_t from, uint32_t to);
+void dumpBin(uint32_t first);
+void dumpFrom(uint32_t offset, uint32_t len);
+void dumpTier(uint32_t n);
+void dumpDeci(uint8_t mode, uint32_t n);
+void cursor(uint32_t seq, uint32_t index);
+void stats(uint32_t from, uint32_t to);
+void tail(uint32_t n);
+void quantiles();
+void find(bool below, uint32_t x);
+void dumpEnd(uint8_t err, int32_t size, Session* first);
 void remove();
 void format();
+void fsstat();
 void checkADC();
 void setDateYMD(uint32_t yyymmdd);
 void setDateHMS(uint32_t hhmmss);
 void setInterval(uint32_t interval);
 void setAppend(bool append);
+void setSync(uint32_t flushes);
+void setBatch(uint32_t bytes);
+void setMaxAge(uint32_t seconds);
+void setStore(uint32_t log);
+void setRing(uint32_t ring);
+void setSegment(uint32_t kb);
 
 void signal(uint8_t wink, bool forever);
 
@@ -50,6 +67,11 @@ int main(void)
     if((err = Config::init()) != FLASH_OK)
         signal(err + 1, true);    
 
+    Sample::import(Config::getDateYMD(), Config::getDateHMS(), Config::getInterval());
+
+    Sample::setStore(Config::getStore());   // dump and remove before sampling
+    Sample::setRing(Config::getRing());
+
     if(gpio_get(START_PIN) == 0)            // start sampling if button pressed
         sample();                   
 
@@ -65,7 +87,54 @@ int main(void)
             sample();
         }
         else if(strcmp(cmd, "dump") == 0){
-            dump();
+            dump(0, 0xffffffff);
+        }
+        else if(strcmp(cmd, "dump_range") == 0){
+            uint32_t to;
+            scanf("%lu", &to);                  // second parameter
+            dump(par, to);
+        }
+        else if(strcmp(cmd, "dump_bin") == 0){
+            dumpBin(par);
+        }
+        else if(strcmp(cmd, "dump_from") == 0){
+            uint32_t len;
+            scanf("%lu", &len);                 // second parameter
+            dumpFrom(par, len);
+        }
+        else if(strcmp(cmd, "dump_avg") == 0){
+            dumpDeci(DECI_MEAN, par);
+        }
+        else if(strcmp(cmd, "dump_minmax") == 0){
+            dumpDeci(DECI_MINMAX, par);
+        }
+        else if(strcmp(cmd, "dump_first") == 0){
+            dumpDeci(DECI_FIRST, par);
+        }
+        else if(strcmp(cmd, "cursor") == 0){
+            uint32_t index;
+            scanf("%lu", &index);               // second parameter
+            cursor(par, index);
+        }
+        else if(strcmp(cmd, "dump_tier") == 0){
+            dumpTier(par);
+        }
+        else if(strcmp(cmd, "stats") == 0){
+            uint32_t to;
+            scanf("%lu", &to);                  // second parameter
+            stats(par, to);
+        }
+        else if(strcmp(cmd, "tail") == 0){
+            tail(par);
+        }
+        else if(strcmp(cmd, "quantiles") == 0){
+            quantiles();
+        }
+        else if(strcmp(cmd, "find_below") == 0){
+            find(true, par);
+        }
+        else if(strcmp(cmd, "find_above") == 0){
+            find(false, par);
         }
         else if(strcmp(cmd, "remove") == 0){
             remove();
@@ -73,6 +142,9 @@ int main(void)
         else if(strcmp(cmd, "format") == 0){
             format();
         }
+        else if(strcmp(cmd, "fsstat") == 0){
+            fsstat();
+        }
         else if(strcmp(cmd, "checkadc") == 0){
             checkADC();
         }
@@ -88,6 +160,24 @@ int main(void)
         else if(strcmp(cmd, "set_append") == 0){
             setAppend((bool)par);
         }
+        else if(strcmp(cmd, "set_sync") == 0){
+            setSync(par);
+        }
+        else if(strcmp(cmd, "set_batch") == 0){
+            setBatch(par);
+        }
+        else if(strcmp(cmd, "set_maxage") == 0){
+            setMaxAge(par);
+        }
+        else if(strcmp(cmd, "set_store") == 0){
+            setStore(par);
+        }
+        else if(strcmp(cmd, "set_ring") == 0){
+            setRing(par);
+        }
+        else if(strcmp(cmd, "set_segment") == 0){
+            setSegment(par);
+        }
         else if(strcmp(cmd, "test") == 0){
             printf("cmd=%s par=%lu\n", cmd, par);
         }
@@ -105,10 +195,18 @@ void sample()
     gpio_put(PICO_DEFAULT_LED_PIN, 0);          // LED off
     sleep_ms(1000);
 
-    uint32_t v = Config::getInterval();         // interval  1..30 s -> 42..60 s save interval
-    Sample::setBufSize(v<31 ? 60/v : 1);        //          31..     -> 31..    
+    uint32_t v = Config::getInterval();
+    Sample::setStore(Config::getStore());       // data file or sample log
+    Sample::setRing(Config::getRing());         // keep newest or stop when full
+    Sample::setSegment(Config::getSegment() * 1024);
+    Sample::setInterval(v);
+    Sample::setBatch(                           // write a page or sector batch, but
+        Config::getBatch(),                     // at least every max age seconds,
+        Config::getMaxAge() / v);               // whole intervals, at least one
+    Sample::setSync(Config::getSync());         // buffer flushes per file sync
     Sleep::setInterval(v);                          
     Sleep::setDate(Config::getDateYMD(), Config::getDateHMS());
+    Sample::start(Config::getDateYMD(), Config::getDateHMS());  // session header
 
     if(!Config::getAppend())                    // if not append
         Sample::remove();                       // remove data file
@@ -139,19 +237,152 @@ void sample()
     }
 }
 
-void dump()
+// samples from <= t < to, seconds since 1970
+//
+void dump(uint32_t from, uint32_t to)
+{
+int32_t size;
+Session first;
+
+    dumpEnd(Sample::dump(from, to, &size, &first), size, &first);
+}
+
+// binary frames from seq first on, the last one carries the result
+//
+void dumpBin(uint32_t first)
+{
+int32_t size;
+Session ses;
+
+    Sample::dumpBin(first, &size, &ses);
+}
+
+// len bytes of samples from byte offset on in binary frames
+//
+void dumpFrom(uint32_t offset, uint32_t len)
+{
+int32_t size;
+Session first;
+
+    Sample::dumpFrom(offset, len, &size, &first);
+}
+
+// mean, min and max of every 10^n samples
+//
+void dumpTier(uint32_t n)
+{
+int32_t size;
+Session first;
+
+    dumpEnd(Sample::dumpTier(n>TIER_MAX ? TIER_MAX : n, &size, &first), size, &first);
+}
+
+// every n samples as their mean, min and max or the first one
+//
+void dumpDeci(uint8_t mode, uint32_t n)
 {
-uint8_t err;    
 int32_t size;
+Session first;
+
+    dumpEnd(Sample::dumpDeci(mode, n, &size, &first), size, &first);
+}
+
+// one line "count offset seq index gap", samples stored, dump_from offset
+// of cursor seq index, the cursor after the newest sample and 1 if the
+// sample at the cursor is no longer stored
+//
+void cursor(uint32_t seq, uint32_t index)
+{
+uint8_t err;
+Cursor c;
 
-    if((err = Sample::dump(&size)) != FLASH_OK){
+    if((err = Sample::cursor(seq, index, &c)) != FLASH_OK){
         if(err == FLASH_MOUNT_ERROR)
             printf("error: mount failed\n");
         else if(err == FLASH_FILE_ERROR) 
             printf("error: invalid data file\n");
     }
     else{
-        printf("%08lu %06lu %06lu %ld\n", Config::getDateYMD(), Config::getDateHMS(), Config::getInterval(), size/2);
+        printf("%lu %lu %lu %lu %lu\n", c.count, c.offset, c.seq, c.index, c.gap);
+    }
+}
+
+// one line "count min max mean stddev" of samples from <= t < to
+//
+void stats(uint32_t from, uint32_t to)
+{
+uint8_t err;
+Stats st;
+
+    if((err = Sample::stats(from, to, &st)) != FLASH_OK){
+        if(err == FLASH_MOUNT_ERROR)
+            printf("error: mount failed\n");
+        else if(err == FLASH_FILE_ERROR) 
+            printf("error: invalid data file\n");
+    }
+    else{
+        printf("%lu %u %u %lu.%02lu %lu.%02lu\n", st.count, st.min, st.max,
+            st.mean / 100, st.mean % 100, st.stddev / 100, st.stddev % 100);
+    }
+}
+
+// newest n samples from RAM, all for n 0, flash is not read
+//
+void tail(uint32_t n)
+{
+int32_t size;
+Session first;
+
+    if(Sample::tail(n, &size, &first) != FLASH_OK)
+        printf("error: no samples in RAM\n");
+    else
+        dumpEnd(FLASH_OK, size, &first);
+}
+
+// lines "session yyyymmdd hhmmss count p1 p50 p99" and "day ..." of the
+// last session and its last day
+//
+void quantiles()
+{
+Sketch ses, day;
+
+    if(Sample::quantiles(&ses, &day) != FLASH_OK){
+        printf("error: no samples\n");
+        return;
+    }
+
+    printf("session %08lu %06lu %lu %u %u %u\n", ses.dateYMD, ses.dateHMS, ses.count,
+        Quantile::get(&ses, 1), Quantile::get(&ses, 50), Quantile::get(&ses, 99));
+    printf("day %08lu %06lu %lu %u %u %u\n", day.dateYMD, day.dateHMS, day.count,
+        Quantile::get(&day, 1), Quantile::get(&day, 50), Quantile::get(&day, 99));
+}
+
+// blocks that may hold samples below or above x
+//
+void find(bool below, uint32_t x)
+{
+int32_t size;
+Session first;
+
+    dumpEnd(Sample::find(below, x>0xffff ? 0xffff : x, &size, &first), size, &first);
+}
+
+void dumpEnd(uint8_t err, int32_t size, Session* first)
+{
+    if(err != FLASH_OK){
+        if(err == FLASH_MOUNT_ERROR)
+            printf("error: mount failed\n");
+        else if(err == FLASH_FILE_ERROR) 
+            printf("error: invalid data file\n");
+    }
+    else{
+        if(first->format == 0){                 // no samples
+            first->dateYMD = Config::getDateYMD();
+            first->dateHMS = Config::getDateHMS();
+            first->interval = Config::getInterval();
+        }
+
+        printf("%08lu %06lu %06lu %ld\n", first->dateYMD, first->dateHMS, first->interval, size/2);
     }
 }
 
@@ -176,6 +407,22 @@ void format()
     printf("OK\n");
 }
 
+// one line "log_size block_size block_count blocks_used store", the sample
+// log region is reserved in front of the file system whichever store is set
+//
+void fsstat()
+{
+struct pico_fsstat_t st;
+
+    if(Sample::fsstat(&st) != FLASH_OK){
+        printf("error: mount failed\n");
+    }
+    else{
+        printf("%lu %lu %lu %lu %lu\n", st.log_size, st.block_size, st.block_count,
+            st.blocks_used, Config::getStore());
+    }
+}
+
 void setDateYMD(uint32_t yyyymmdd)
 {
     Config::setDateYMD(yyyymmdd);    
@@ -204,6 +451,52 @@ void setAppend(bool append)
     printf("OK\n");    
 }
 
+void setSync(uint32_t flushes)
+{
+    Config::setSync(flushes<1 ? 1 : flushes>255 ? 255 : flushes);
+    Config::save();
+    printf("OK\n");
+}
+
+void setBatch(uint32_t bytes)
+{
+    bytes = bytes<BATCH_MIN ? BATCH_MIN : bytes>BATCH_MAX ? BATCH_MAX : bytes;
+    Config::setBatch(bytes / BATCH_MIN * BATCH_MIN);          // whole pages
+    Config::save();
+    printf("OK\n");
+}
+
+void setMaxAge(uint32_t seconds)
+{
+    Config::setMaxAge(seconds);
+    Config::save();
+    printf("OK\n");
+}
+
+void setStore(uint32_t log)
+{
+    Config::setStore(log ? 1 : 0);
+    Config::save();
+    Sample::setStore(log);
+    printf("OK\n");
+}
+
+void setRing(uint32_t ring)
+{
+    Config::setRing(ring ? 1 : 0);
+    Config::save();
+    Sample::setRing(ring);
+    printf("OK\n");
+}
+
+void setSegment(uint32_t kb)
+{
+    kb = kb<SEGMENT_MIN/1024 ? SEGMENT_MIN/1024 : kb>SEGMENT_LIM/1024 ? SEGMENT_LIM/1024 : kb;
+    Config::setSegment(kb / 4 * 4);                             // whole sectors
+    Config::save();
+    printf("OK\n");
+}
+
 void checkADC()
 {
     printf("0x%04x\n", adc_read());
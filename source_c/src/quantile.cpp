@@ -0,0 +1,58 @@
+#include <string.h>
+#include "quantile.h"
+
+void Quantile::clear(Sketch* s, uint32_t ymd, uint32_t hms)
+{
+    memset(s, 0, sizeof(Sketch));
+    s->dateYMD = ymd;
+    s->dateHMS = hms;
+}
+
+void Quantile::add(Sketch* s, uint16_t x)
+{
+    uint16_t* b = &s->bin[(x < SKETCH_RANGE ? x : SKETCH_RANGE - 1) / SKETCH_WIDTH];
+
+    if(*b == 0xffff){                                       // halve all, an odd count carries
+        uint32_t carry = 0;                                 // its half sample to the next bin
+
+        for(uint16_t i=0; i<SKETCH_BINS; i++){
+            uint32_t v = s->bin[i] + carry;
+            s->bin[i] = v / 2;
+            carry = v % 2;
+        }
+    }
+
+    (*b)++;
+    s->count++;
+}
+
+// value below which percent of the samples lie, the rank is located in
+// hundredths of a sample and interpolated linearly inside its bin
+//
+uint16_t Quantile::get(const Sketch* s, uint8_t percent)
+{
+    uint32_t total = 0;
+
+    for(uint16_t i=0; i<SKETCH_BINS; i++)
+        total += s->bin[i];
+
+    if(total == 0)
+        return 0;
+
+    uint32_t rank = total * (percent > 100 ? 100 : percent);   // < 2^29
+    uint32_t cum = 0;
+    uint32_t v = SKETCH_RANGE - 1;
+
+    for(uint16_t i=0; i<SKETCH_BINS; i++){
+        uint32_t n = s->bin[i] * 100;
+
+        if(n && cum+n >= rank){
+            v = i * SKETCH_WIDTH + (uint64_t)(rank - cum) * SKETCH_WIDTH / n;
+            break;
+        }
+
+        cum += n;
+    }
+
+    return v < SKETCH_RANGE ? v : SKETCH_RANGE - 1;
+}
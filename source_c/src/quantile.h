@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdint.h>
+
+#define SKETCH_BINS         64                          // equal width bins over the sample range
+#define SKETCH_RANGE        4096                        // 2^ADC_BITS
+#define SKETCH_WIDTH        (SKETCH_RANGE / SKETCH_BINS)
+
+// bounded quantile sketch, a histogram of 16 bit counters that are halved
+// together when one would overflow, so the ranks stay proportional however
+// long it runs, halving rounds down and carries the odd halves upward so
+// sparse bins decay as the rest, quantiles are interpolated within a bin,
+// error below one bin width
+//
+typedef struct Sketch{
+    uint32_t dateYMD;                       // first sample yyyymmdd, day or session start
+    uint32_t dateHMS;                       //                hhmmss
+    uint32_t count;                         // samples added
+    uint16_t bin[SKETCH_BINS];
+}Sketch;
+
+class Quantile
+{
+    public:
+        static void clear(Sketch* s, uint32_t ymd, uint32_t hms);
+        static void add(Sketch* s, uint16_t x);
+        static uint16_t get(const Sketch* s, uint8_t percent);
+};
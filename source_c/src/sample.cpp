@@ -1,140 +1,1459 @@
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
 #include "sample.h"
+#include "frame.h"
 
 uint16_t* Sample::sBuf;
-uint8_t Sample::sBufSize;
-uint8_t Sample::sbi;
+uint16_t Sample::sBufSize;
+uint16_t Sample::sbi;
+uint32_t Sample::maxUnsaved = 1;
+uint32_t Sample::unsaved;
+uint32_t Sample::fileSize;
+uint32_t Sample::segBytes = 16384;
+Segment Sample::segs[SEGMENT_MAX];
+Zone Sample::zones[SEGMENT_LIM / ZONE_BYTES];
+uint8_t Sample::segCount;
+uint32_t Sample::segNext;
+bool Sample::ring;
+bool Sample::logStore;
+uint32_t Sample::interval = 1;
+Session Sample::session;
+uint32_t Sample::time;
+uint32_t Sample::bufTime;
+SketchFile Sample::sketch;
+bool Sample::mounted;
+int Sample::file = -1;
+uint16_t Sample::dBuf[FRAME_WORDS];
+uint16_t Sample::dbi;
+char Sample::dOut[DUMP_OUT];
+uint16_t Sample::doi;
+uint16_t Sample::dWidth = DUBLWI;
+bool Sample::dFrames;
+uint32_t Sample::dPos;
+uint32_t Sample::dFirst;
+uint32_t Sample::dLast = 0xffffffff;
+Session Sample::dSes;
+uint32_t Sample::dNext;
+int32_t Sample::dSize;
+uint32_t Sample::dFactor = 1;
+Zone Sample::tZone;
+uint32_t Sample::tCount;
+uint8_t Sample::tMode;
+uint16_t Sample::tFirst;
+uint16_t Sample::tBuf[DUBLWI];
+uint16_t Sample::tbi;
+Stats* Sample::dStats;
+bool Sample::dReplay;
+bool Sample::dSkip;
+uint8_t Sample::syncFlushes = 1;
+uint8_t Sample::unsynced;
 
+static Tail __uninitialized_ram(tailRam);                  // not zeroed at boot
+
+// mounts the file system for the whole session, formats flash if needed
+//
 uint8_t Sample::init()
 {
     uint8_t err = FLASH_OK;
-    sBufSize = 1;
 
     adc_init();
     adc_gpio_init(ADC_PIN);
     adc_select_input(0);
 
+    if(mounted){                                            // reinit
+        closeFile();
+        pico_unmount();
+        mounted = false;
+        memset(&sketch, 0, sizeof(SketchFile));             // reloaded as after reset
+    }
+
     if(pico_mount(false) != LFS_ERR_OK){
         if(pico_mount(true) != LFS_ERR_OK)                  // format flash
             err = FLASH_FORMAT_ERROR;
-        else
-            pico_unmount();
     }
 
+    mounted = err == FLASH_OK;
+
+    if(mounted){
+        pico_mkdir(SAMPLE_DIR);                             // exists after first boot
+        loadIndex();
+    }
+
+    Store::init();
+
     return err;
 }
 
-// size of buffer to collect samples before saving to flash
+// data.bin of older firmware becomes the oldest segment, renamed without
+// copy, its samples take the date and interval of the settings as the old
+// dump did, the index entry goes first so a reset leaves at most an entry
+// without file and data.bin is imported again
+//
+uint8_t Sample::import(uint32_t ymd, uint32_t hms, uint32_t interval)
+{
+    struct lfs_info info;
+    char name[24];
+
+    if(!mounted || pico_stat(LEGACY_FILE_NAME, &info)!=LFS_ERR_OK)
+        return FLASH_OK;
+
+    if(info.size == 0)
+        return pico_remove(LEGACY_FILE_NAME)==LFS_ERR_OK ? FLASH_OK : FLASH_FILE_ERROR;
+
+    if(segCount == SEGMENT_MAX)                             // kept until remove()
+        return FLASH_FULL_ERROR;
+
+    memmove(segs + 1, segs, segCount * sizeof(Segment));
+    segs[0].seq = segNext++;
+    segs[0].time = 0;
+    segs[0].session.dateYMD = ymd;
+    segs[0].session.dateHMS = hms;
+    segs[0].session.interval = interval;
+    segs[0].session.channels = SAMPLE_CHANNELS;
+    segs[0].session.bits = ADC_BITS;
+    segs[0].session.format = SESSION_FORMAT;
+    segCount++;
+
+    if(saveIndex() != FLASH_OK)
+        return FLASH_FILE_ERROR;
+
+    segName(name, segs[0].seq, "bin");
+
+    return pico_rename(LEGACY_FILE_NAME, name)==LFS_ERR_OK ? FLASH_OK : FLASH_FILE_ERROR;
+}
+
+// a closed segment is never appended again, its zone map is written now
+//
+void Sample::closeFile()
+{
+    if(file >= 0){
+        pico_close(file);
+        file = -1;
+        saveZones();
+    }
+
+    unsynced = 0;
+}
+
+void Sample::segName(char* name, uint32_t seq, const char* ext)
+{
+    sprintf(name, SAMPLE_DIR "/%05u.%s", (unsigned)seq, ext);
+}
+
+// zone map file of the newest segment, one Zone per ZONE_BYTES of samples,
+// a segment without one is read in full by queries
+//
+uint8_t Sample::saveZones()
+{
+    char name[24];
+    uint32_t n = (fileSize / SAMPLE_BYTES + ZONE_SAMPLES - 1) / ZONE_SAMPLES;
+
+    if(segCount==0 || n==0)
+        return FLASH_OK;
+
+    segName(name, segs[segCount-1].seq, "zon");
+    int f = pico_open(name, LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC);
+
+    if(f < 0)
+        return FLASH_FILE_ERROR;
+
+    pico_write(f, zones, n * sizeof(Zone));
+    pico_close(f);
+
+    return FLASH_OK;
+}
+
+uint8_t Sample::loadIndex()
+{
+    int f = pico_open(INDEX_FILE_NAME, LFS_O_RDONLY);
+    segCount = 0;
+    segNext = 0;
+
+    if(f < 0)
+        return FLASH_FILE_ERROR;
+
+    lfs_soff_t size = pico_size(f);
+    lfs_soff_t n = size / sizeof(Segment);
+    segCount = n<0 ? 0 : n>SEGMENT_MAX ? SEGMENT_MAX : n;
+    pico_read(f, segs, segCount * sizeof(Segment));
+
+    if(size % sizeof(Segment) == sizeof(segNext))           // trailer, older index files have none
+        pico_read(f, &segNext, sizeof(segNext));
+
+    if(segCount && segNext<=segs[segCount-1].seq)
+        segNext = segs[segCount-1].seq + 1;
+
+    pico_close(f);
+
+    return FLASH_OK;
+}
+
+// rewritten whole, a few hundred bytes at most, littlefs commits it atomically,
+// the seq of the next segment follows the entries
+//
+uint8_t Sample::saveIndex()
+{
+    int f = pico_open(INDEX_FILE_NAME, LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC);
+
+    if(f < 0)
+        return FLASH_FILE_ERROR;
+
+    lfs_size_t n = segCount * sizeof(Segment);
+    bool ok = (lfs_size_t)pico_write(f, segs, n) == n &&
+        pico_write(f, &segNext, sizeof(segNext)) == sizeof(segNext);
+
+    return pico_close(f)==LFS_ERR_OK && ok ? FLASH_OK : FLASH_FILE_ERROR;
+}
+
+// the last checkpoint, then the samples flushed after it are read back from
+// the store, SKETCH_SAMPLES at most, so the sketches cover every sample on
+// flash without a file write per flush
+//
+uint8_t Sample::loadSketch()
+{
+    int f = pico_open(SKETCH_FILE_NAME, LFS_O_RDONLY);
+
+    if(f < 0)
+        return FLASH_FILE_ERROR;
+
+    bool ok = pico_read(f, &sketch, sizeof(SketchFile)) == sizeof(SketchFile);
+    pico_close(f);
+
+    if(!ok){
+        memset(&sketch, 0, sizeof(SketchFile));
+        return FLASH_FILE_ERROR;
+    }
+
+    Session first;
+    uint32_t from = toEpoch(&sketch.session) + sketch.time;
+
+    dumpBegin(&first);
+    dReplay = true;
+
+    if(logStore)
+        dumpLog(from, 0xffffffff, &first);
+    else
+        dumpFile(from, 0xffffffff, &first);
+
+    dReplay = false;
+
+    return FLASH_OK;
+}
+
+// inline in its littlefs directory entry, a few hundred bytes
+//
+uint8_t Sample::saveSketch()
+{
+    if(!mounted)
+        return FLASH_MOUNT_ERROR;
+
+    int f = pico_open(SKETCH_FILE_NAME, LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC);
+
+    if(f < 0)
+        return FLASH_FILE_ERROR;
+
+    sketch.time = time;
+    bool ok = pico_write(f, &sketch, sizeof(SketchFile)) == sizeof(SketchFile);
+
+    return pico_close(f)==LFS_ERR_OK && ok ? FLASH_OK : FLASH_FILE_ERROR;
+}
+
+// sample x at t seconds since session start, a new day starts a new day sketch
+//
+void Sample::addSketch(uint16_t x, uint32_t t)
+{
+    if(t >= sketch.dayEnd){
+        uint32_t ymd = sketch.session.dateYMD, hms = sketch.session.dateHMS;
+        addTime(&ymd, &hms, t);
+        Quantile::clear(&sketch.day, ymd, hms);
+
+        while(sketch.dayEnd <= t)
+            sketch.dayEnd += 86400;
+    }
+
+    Quantile::add(&sketch.ses, x);
+    Quantile::add(&sketch.day, x);
+}
+
+// closes the newest segment and starts the next one with first sample time t,
+// the index names it before the file exists, a missing file reads as empty
+//
+uint8_t Sample::newSegment(uint32_t t)
+{
+    uint8_t err;
+    char name[24];
+
+    closeFile();
+
+    if(segCount == SEGMENT_MAX){
+        if(!ring)
+            return FLASH_FULL_ERROR;
+
+        if((err = dropSegment()) != FLASH_OK)
+            return err;
+    }
+
+    Segment* g = &segs[segCount];
+    g->seq = segNext++;
+    g->time = t;
+    g->session = session;
+    segCount++;
+
+    if((err = saveIndex()) != FLASH_OK)
+        return err;
+
+    segName(name, g->seq, "bin");
+    file = pico_open(name, LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC);
+    fileSize = 0;
+
+    return file >= 0 ? FLASH_OK : FLASH_FILE_ERROR;
+}
+
+// frees the oldest segment, its file goes first so a reset leaves at most
+// an index entry without file
 //
-void Sample::setBufSize(uint8_t size)                          
+uint8_t Sample::dropSegment()
 {
+    char name[24];
+
+    if(segCount == 0)
+        return FLASH_FILE_ERROR;
+
+    segName(name, segs[0].seq, "bin");
+    pico_remove(name);
+    segName(name, segs[0].seq, "zon");
+    pico_remove(name);
+
+    segCount--;
+    memmove(segs, segs + 1, segCount * sizeof(Segment));
+
+    return saveIndex();
+}
+
+// segments are sized in whole flash sectors so page batches never straddle
+//
+void Sample::setSegment(uint32_t bytes)
+{
+    bytes = bytes<SEGMENT_MIN ? SEGMENT_MIN : bytes>SEGMENT_LIM ? SEGMENT_LIM : bytes;
+    segBytes = bytes / SEGMENT_MIN * SEGMENT_MIN;
+}
+
+// RAM batch of samples written to flash at once, BATCH_MIN..BATCH_MAX bytes,
+// batches end on multiples of its size in the data file so whole program
+// pages are written, maxUnsaved bounds the samples lost on reset or power
+// loss (sleep keeps SRAM), reaching it writes and commits early
+//
+void Sample::setBatch(uint16_t bytes, uint32_t maxUnsaved)
+{
+    bytes = bytes<BATCH_MIN ? BATCH_MIN : bytes>BATCH_MAX ? BATCH_MAX : bytes;
+
     if(sBuf) free(sBuf);
-    sBuf = (uint16_t*)malloc(size * SAMPLE_BYTES);
-    sBufSize = size;
+    sBuf = (uint16_t*)malloc(bytes);
+    sBufSize = bytes / SAMPLE_BYTES;
+    sbi = 0;
+
+    Sample::maxUnsaved = maxUnsaved ? maxUnsaved : 1;
+    unsaved = 0;
+}
+
+// a sampling session starts at date ymd hms with the current interval,
+// its header goes into the next log sector or data segment, the session
+// sketch starts empty, the day sketch continues one of the same date
+//
+uint8_t Sample::start(uint32_t ymd, uint32_t hms)
+{
+    session.dateYMD = ymd;
+    session.dateHMS = hms;
+    session.interval = interval;
+    session.channels = SAMPLE_CHANNELS;
+    session.bits = ADC_BITS;
+    session.format = SESSION_FORMAT;
+
+    time = 0;
     sbi = 0;
+    unsaved = 0;
+    closeFile();                                            // next save starts a segment
+
+    if(sketch.ses.count==0 && mounted)                     // after reset
+        loadSketch();
+
+    if(sketch.day.count==0 || sketch.day.dateYMD!=ymd)
+        Quantile::clear(&sketch.day, ymd, hms);
+
+    sketch.session = session;
+    sketch.dayEnd = 86400 - (hms / 10000 * 3600 + hms / 100 % 100 * 60 + hms % 100);
+    Quantile::clear(&sketch.ses, ymd, hms);
+    saveSketch();
+
+    tailRam.magic = TAIL_MAGIC;
+    tailRam.session = session;
+    tailRam.time = 0;
+    tailRam.count = 0;
+    tailRam.head = 0;
+    tailRam.crc = tailCrc();
+
+    return logStore ? Store::begin(&session) : FLASH_OK;
 }
 
 uint8_t Sample::sample()
 {    
     uint8_t err = FLASH_OK;
 
-    sBuf[sbi++] = adc_read();
+    if(sbi == 0)
+        bufTime = time;
+
+    sBuf[sbi] = adc_read();
+    addSketch(sBuf[sbi], time);
+    addTail(sBuf[sbi++]);
+    time += interval;
+    bool due = ++unsaved >= maxUnsaved;                     // max age reached
 
-    if(sbi >= sBufSize){
-        if(pico_mount(false) != LFS_ERR_OK){
+    // words up to the next batch boundary in the data file or log sector
+    uint32_t pos = logStore ? Store::getPos() : fileSize;
+    uint16_t fill = sBufSize - pos / SAMPLE_BYTES % sBufSize;
+
+    if(sbi>=fill || due){
+        if(logStore)
+            err = saveLog();
+        else if(!mounted)
             err = FLASH_MOUNT_ERROR;
+        else
+            err = save(due);
+
+        if(err != FLASH_OK)                                 // samples dropped
+            unsaved = 0;
+        else if(time - sketch.time >= SKETCH_SAMPLES * interval)
+            saveSketch();                                   // all in sketch are on flash
+
+        sbi = 0;
+    }
+
+    return err;
+}
+
+// every session starts a new segment, a full segment is closed and the
+// buffer continues in the next, so does one after dropped samples, a full
+// file system drops the oldest segment in ring mode
+//
+uint8_t Sample::save(bool due)
+{
+    uint8_t err = FLASH_OK;
+
+    for(uint16_t done=0; done<sbi;){
+        uint32_t t = bufTime + done * interval;
+
+        if(file<0 || fileSize>=segBytes ||                  // new session, full or gap
+            t!=segs[segCount-1].time+fileSize/SAMPLE_BYTES*interval){
+            if((err = newSegment(t)) != FLASH_OK)
+                return err;
         }
-        else{
-            struct pico_fsstat_t stat;
-            pico_fsstat(&stat);
-            uint16_t blocksFree = stat.block_count - stat.blocks_used;
-
-            if(blocksFree >= BLOCKS_MIN_FREE){
-                int file = pico_open(SAMPLE_FILE_NAME, LFS_O_WRONLY | LFS_O_CREAT | LFS_O_APPEND);
-
-                if(file >= 0){
-                    pico_write(file, sBuf, sBufSize * SAMPLE_BYTES);
-                    pico_close(file);
-                }
-                else{
-                    err = FLASH_FILE_ERROR;
-                }
-            }
-            else{
-                err = FLASH_FULL_ERROR;
+
+        struct pico_fsstat_t stat;
+        pico_fsstat(&stat);
+        uint16_t blocksFree = stat.block_count - stat.blocks_used;
+
+        if(blocksFree < BLOCKS_MIN_FREE){
+            if(!ring || segCount<2)
+                return FLASH_FULL_ERROR;
+
+            if((err = dropSegment()) != FLASH_OK)
+                return err;
+
+            continue;
+        }
+
+        uint32_t n = (segBytes - fileSize) / SAMPLE_BYTES;   // 131072 for SEGMENT_LIM
+        uint32_t left = sbi - done;
+        n = left < n ? left : n;
+
+        if(pico_write(file, sBuf + done, n * SAMPLE_BYTES) != n * SAMPLE_BYTES){
+            pico_truncate(file, fileSize);                  // segment and zone map end
+            pico_lseek(file, fileSize, LFS_SEEK_SET);       // before the failed write
+            return FLASH_FILE_ERROR;
+        }
+
+        for(uint32_t i=0, p=fileSize/SAMPLE_BYTES; i<n;){        // zone map
+            Zone* z = &zones[p / ZONE_SAMPLES];
+            uint32_t k = ZONE_SAMPLES - p % ZONE_SAMPLES;
+            k = n-i < k ? n-i : k;
+
+            if(p % ZONE_SAMPLES == 0){
+                z->min = 0xffff;
+                z->max = 0;
+                z->sum = 0;
             }
 
-            pico_unmount();
+            Store::addZone(z, sBuf + done + i, k);
+            i += k;
+            p += k;
         }
 
-        sbi = 0;
+        fileSize += n * SAMPLE_BYTES;
+        done += n;
+    }
+
+    if(++unsynced>=syncFlushes || due){                     // commit to flash
+        pico_fflush(file);
+        unsynced = 0;
+        unsaved = 0;
     }
 
     return err;
 }
 
-uint8_t Sample::dump(int32_t* size)
+// appended into erased flash of the current log sector, committed at once
+//
+uint8_t Sample::saveLog()
+{
+    uint8_t err = Store::write(sBuf, sbi, bufTime);
+
+    if(err == FLASH_OK)
+        unsaved = 0;
+
+    return err;
+}
+
+// samples DUBLWI per line, every run of contiguous samples is preceded by a
+// header line "S format yyyymmdd hhmmss interval channels bits" with the
+// date of its first sample, first returns that of the first run, only
+// samples at from <= t < to are dumped, times in seconds since 1970
+//
+uint8_t Sample::dump(uint32_t from, uint32_t to, int32_t* size, Session* first)
+{
+    return dumpAll(from, to, 1, DECI_TIER, false, size, first);
+}
+
+// all samples as dump() in binary frames, frames before seq first are left
+// out to send damaged ones again, ends with a FRAME_END of the result
+//
+uint8_t Sample::dumpBin(uint32_t first, int32_t* size, Session* ses)
+{
+    Frame::begin(first);
+    uint8_t err = dumpAll(0, 0xffffffff, 1, DECI_TIER, true, size, ses);
+    frameEnd(err, *size, ses);
+
+    return err;
+}
+
+// len bytes of samples from byte offset on, counted over all stored samples
+// oldest first as dump() sends them, in binary frames, every frame carries
+// its crc so a client resumes at the end of the last good one, sectors and
+// segments before offset are counted from their headers and not read
+//
+uint8_t Sample::dumpFrom(uint32_t offset, uint32_t len, int32_t* size, Session* first)
 {
     uint8_t err = FLASH_OK;
 
-    if(pico_mount(false) != LFS_ERR_OK){
+    Frame::begin(0);
+    dumpBegin(first);
+    dFrames = true;
+    dWidth = FRAME_WORDS;
+    dFirst = offset / SAMPLE_BYTES;
+    dLast = dFirst + (len/SAMPLE_BYTES < 0xffffffff-dFirst ? len/SAMPLE_BYTES : 0xffffffff-dFirst);
+
+    if(logStore){
+        err = dumpLog(0, 0xffffffff, first);
+    }
+    else if(!mounted){
         err = FLASH_MOUNT_ERROR;
     }
     else{
-        int file = pico_open(SAMPLE_FILE_NAME, LFS_O_RDONLY);
+        err = dumpFile(0, 0xffffffff, first);
+    }
 
-        if(file >= 0){
-            uint16_t buf[DUBLWI];
-            int32_t s = pico_size(file);
-            *size = s;
+    dumpFlush();
+    *size = dSize;
+    frameEnd(err, *size, first);
+
+    return err;
+}
 
-            while(s){
-                uint16_t a = s>=DUBLWI*2 ? DUBLWI*2 : s;
-                pico_read(file, buf, a);
+// position after the newest sample and the byte offset of cursor seq index
+// as dump_from counts it, a client that keeps the cursor of its last dump
+// gets the samples added since, gap if the sample at the cursor was dropped
+// or removed, all samples are new then, the samples are counted from the
+// log seals or segment sizes, not read
+//
+uint8_t Sample::cursor(uint32_t seq, uint32_t index, Cursor* c)
+{
+    memset(c, 0, sizeof(Cursor));
+    c->gap = 1;
 
-                for(uint16_t i=0; i<a/2; i++)
-                    printf("0x%04x ", buf[i]);
+    if(logStore){
+        LogHead h;
+        uint32_t n;
 
-                printf("\n");
-                s -= a;
-            }
-        
-            pico_close(file);
+        for(uint32_t s=Store::getTail(); !Store::isEmpty() && s<=Store::getHead(); s++){
+            if(Store::readCount(s, &h, &n))                 // as dumpLog, from the seals
+                cursorAt(c, s, n, seq, index);
         }
-        else{
-            err = FLASH_FILE_ERROR;
+    }
+    else if(!mounted){
+        return FLASH_MOUNT_ERROR;
+    }
+    else{
+        char name[24];
+        closeFile();                                        // commit pending samples
+        c->seq = segNext;
+
+        for(uint8_t g=0; g<segCount; g++){
+            segName(name, segs[g].seq, "bin");
+            int f = pico_open(name, LFS_O_RDONLY);
+
+            if(f < 0)                                       // as dumpFile
+                continue;
+
+            cursorAt(c, segs[g].seq, pico_size(f) / SAMPLE_BYTES, seq, index);
+            pico_close(f);
         }
+    }
 
-        pico_unmount();
+    if(c->gap)
+        c->offset = 0;
+
+    return FLASH_OK;
+}
+
+// adds sector or segment seq of count samples to c, s i is the cursor asked for
+//
+void Sample::cursorAt(Cursor* c, uint32_t seq, uint32_t count, uint32_t s, uint32_t i)
+{
+    if(seq==s && i<=count){
+        c->offset = (c->count + i) * SAMPLE_BYTES;
+        c->gap = 0;
+    }
+
+    c->count += count;
+    c->seq = seq;
+    c->index = count;
+}
+
+void Sample::frameEnd(uint8_t err, int32_t size, const Session* first)
+{
+    FrameEnd e;
+    e.err = err;
+    e.size = size;
+    e.first = *first;
+    Frame::send(FRAME_END, &e, sizeof(FrameEnd));
+}
+
+// overview of all samples, every 10^n samples of a run give one record of
+// mean, min and max, 3 words in the dump format, the run header carries
+// the interval of the records and 3 channels, the last record of a run
+// may cover fewer samples, computed on the fly from the stored samples
+//
+uint8_t Sample::dumpTier(uint8_t n, int32_t* size, Session* first)
+{
+    uint32_t factor = 1;
+
+    for(n=n>TIER_MAX ? TIER_MAX : n; n; n--)
+        factor *= 10;
+
+    return dumpAll(0, 0xffffffff, factor, DECI_TIER, false, size, first);
+}
+
+// all samples decimated by n while reading, every n samples of a run give
+// the record of mode, mean, min and max or the first sample, the run header
+// carries the interval of the records and the words per record as channels
+//
+uint8_t Sample::dumpDeci(uint8_t mode, uint32_t n, int32_t* size, Session* first)
+{
+    n = n<1 ? 1 : n>DECI_MAX ? DECI_MAX : n;
+
+    return dumpAll(0, 0xffffffff, n, mode, false, size, first);
+}
+
+uint8_t Sample::dumpAll(uint32_t from, uint32_t to, uint32_t factor, uint8_t mode, bool frames, int32_t* size, Session* first)
+{
+    uint8_t err = FLASH_OK;
+
+    dumpBegin(first);
+    dFactor = factor;
+    tMode = mode;
+    dFrames = frames;
+    dWidth = frames ? FRAME_WORDS : DUBLWI;
+
+    if(logStore){
+        err = dumpLog(from, to, first);
+    }
+    else if(!mounted){
+        err = FLASH_MOUNT_ERROR;
+    }
+    else{
+        err = dumpFile(from, to, first);
     }
 
+    tierEnd();
+    dumpFlush();
+    *size = dSize;
+
     return err;
 }
 
-uint8_t Sample::remove()
+// min, max, mean and standard deviation of the samples at from <= t < to,
+// read as dump() reads them but nothing is printed, count 0 without samples
+//
+uint8_t Sample::stats(uint32_t from, uint32_t to, Stats* st)
 {
     uint8_t err = FLASH_OK;
+    Session first;
 
-    if(pico_mount(false) != LFS_ERR_OK){
+    dumpBegin(&first);
+    memset(st, 0, sizeof(Stats));
+    st->min = 0xffff;
+    dStats = st;
+
+    if(logStore){
+        err = dumpLog(from, to, &first);
+    }
+    else if(!mounted){
         err = FLASH_MOUNT_ERROR;
     }
     else{
-        if(pico_remove(SAMPLE_FILE_NAME) < 0)
-            err = FLASH_FILE_ERROR;
+        err = dumpFile(from, to, &first);
+    }
 
-        pico_unmount();
+    dStats = NULL;
+
+    if(st->count == 0){
+        st->min = 0;
+        return err;
     }
 
+    uint64_t n = st->count;                                 // n * squares < 2^63 for 2^19 12 bit samples
+    st->mean = (st->sum * 100 + n / 2) / n;
+    st->stddev = isqrt((n * st->squares - st->sum * st->sum) / n * 10000 / n);
+
     return err;
 }
 
-uint8_t Sample::format()
+uint32_t Sample::isqrt(uint64_t x)
 {
-    uint8_t err = FLASH_OK;
+    uint64_t r = 0, b = (uint64_t)1 << 62;
 
-    if(pico_mount(true) != LFS_ERR_OK)                  // format flash
-        err = FLASH_FORMAT_ERROR;
-    else
-        pico_unmount();
+    while(b > x)
+        b >>= 2;
+
+    while(b){
+        if(x >= r + b){
+            x -= r + b;
+            r = (r >> 1) + b;
+        }
+        else{
+            r >>= 1;
+        }
+
+        b >>= 2;
+    }
+
+    return (uint32_t)r;
+}
+
+// the newest n samples, all for n 0, dumped as dump() from the RAM tail
+// without flash access, they include those not yet written before a reset
+//
+uint8_t Sample::tail(uint32_t n, int32_t* size, Session* first)
+{
+    dumpBegin(first);
+    *size = 0;
+
+    if(tailRam.magic!=TAIL_MAGIC || tailRam.crc!=tailCrc() || tailRam.count>TAIL_SAMPLES)
+        return FLASH_FILE_ERROR;
+
+    n = n==0 || n>tailRam.count ? tailRam.count : n;
+
+    if(n == 0)
+        return FLASH_OK;
+
+    uint32_t i = (tailRam.head + TAIL_SAMPLES - n) % TAIL_SAMPLES;
+    dumpRun(&tailRam.session, tailRam.time - n * tailRam.session.interval, first);
+
+    while(n){
+        uint32_t k = TAIL_SAMPLES-i < n ? TAIL_SAMPLES-i : n;   // up to the wrap
+        dumpWords(tailRam.buf + i, k);
+        i = (i + k) % TAIL_SAMPLES;
+        n -= k;
+    }
+
+    dumpFlush();
+    *size = dSize;
+
+    return FLASH_OK;
+}
+
+void Sample::addTail(uint16_t x)
+{
+    tailRam.buf[tailRam.head] = x;
+    tailRam.head = (tailRam.head + 1) % TAIL_SAMPLES;
+    tailRam.count += tailRam.count < TAIL_SAMPLES;
+    tailRam.time += tailRam.session.interval;
+    tailRam.crc = tailCrc();
+}
+
+uint32_t Sample::tailCrc()
+{
+    return Store::crc32(0, &tailRam, offsetof(Tail, crc));
+}
+
+// quantile sketches of the current or, after reset, the last session and
+// of its last day
+//
+uint8_t Sample::quantiles(Sketch* ses, Sketch* day)
+{
+    if(sketch.ses.count==0 && mounted)
+        loadSketch();
+
+    *ses = sketch.ses;
+    *day = sketch.day;
+
+    return ses->count ? FLASH_OK : FLASH_FILE_ERROR;
+}
+
+// dumps as dump() the blocks that may hold a sample below or above x,
+// FIND_SAMPLES of the sample log or ZONE_BYTES of a data segment each,
+// blocks whose zone map excludes x are not read
+//
+uint8_t Sample::find(bool below, uint16_t x, int32_t* size, Session* first)
+{
+    uint8_t err = FLASH_OK;
+
+    dumpBegin(first);
+
+    if(logStore){
+        err = findLog(below, x, first);
+    }
+    else if(!mounted){
+        err = FLASH_MOUNT_ERROR;
+    }
+    else{
+        err = findFile(below, x, first);
+    }
+
+    dumpFlush();
+    *size = dSize;
+
+    return err;
+}
+
+uint8_t Sample::findFile(bool below, uint16_t x, Session* first)
+{
+    closeFile();                                            // zone map of newest
+
+    if(segCount == 0)
+        return FLASH_FILE_ERROR;
+
+    char name[24];
+
+    for(uint8_t g=0; g<segCount; g++){
+        segName(name, segs[g].seq, "bin");
+        int f = pico_open(name, LFS_O_RDONLY);
+
+        if(f < 0)
+            continue;
+
+        segName(name, segs[g].seq, "zon");
+        int zf = pico_open(name, LFS_O_RDONLY);             // <0 reads all blocks
+        uint32_t n = pico_size(f) / SAMPLE_BYTES;
+
+        for(uint32_t b=0; b*ZONE_SAMPLES<n; b++){
+            Zone z;
+
+            if(zf>=0 && pico_read(zf, &z, sizeof(Zone))==sizeof(Zone) && !match(&z, below, x))
+                continue;
+
+            uint32_t i = b * ZONE_SAMPLES;
+            uint32_t i1 = n-i < ZONE_SAMPLES ? n : i + ZONE_SAMPLES;
+
+            dumpRun(&segs[g].session, segs[g].time + i * segs[g].session.interval, first);
+            pico_lseek(f, i * SAMPLE_BYTES, LFS_SEEK_SET);
+            dumpRead(f, i1 - i);
+        }
+
+        if(zf >= 0)
+            pico_close(zf);
+
+        pico_close(f);
+    }
+
+    return FLASH_OK;
+}
+
+// sectors whose sealed zone map cannot match are not read, the others are
+// scanned on chip and only their FIND_SAMPLES blocks with a match are dumped
+//
+uint8_t Sample::findLog(bool below, uint16_t x, Session* first)
+{
+    if(Store::isEmpty())
+        return FLASH_FILE_ERROR;
+
+
+    for(uint32_t seq=Store::getTail(); seq<=Store::getHead(); seq++){
+        LogHead h;
+        Zone z;
+        uint32_t count;
+
+        if(Store::readZone(seq, &z) && !match(&z, below, x))
+            continue;
+
+        if(!Store::read(seq, &h, &count))                   // skip damaged sector
+            continue;
+
+        for(uint32_t b=0; b<count; b+=FIND_SAMPLES){
+            uint32_t n = count-b < FIND_SAMPLES ? count-b : FIND_SAMPLES;
+            const uint16_t* p = Store::samples(seq, b, n);  // in place
+
+            z.min = 0xffff;                                 // block zone map
+            z.max = 0;
+            Store::addZone(&z, p, n);
+
+            if(!match(&z, below, x))
+                continue;
+
+            dumpRun(&h.session, h.time + b * h.session.interval, first);
+            dumpWords(p, n);
+        }
+    }
+
+    return FLASH_OK;
+}
+
+bool Sample::match(const Zone* z, bool below, uint16_t x)
+{
+    return below ? z->min < x : z->max > x;
+}
+
+void Sample::dumpBegin(Session* first)
+{
+    memset(first, 0, sizeof(Session));
+    memset(&dSes, 0, sizeof(Session));
+    dbi = 0;
+    dSize = 0;
+    dFactor = 1;
+    tMode = DECI_TIER;
+    tbi = 0;
+    tCount = 0;
+    tZone.min = 0xffff;
+    tZone.max = 0;
+    tZone.sum = 0;
+    dStats = NULL;
+    dReplay = false;
+    dFrames = false;
+    dWidth = DUBLWI;
+    dPos = 0;
+    dFirst = 0;
+    dLast = 0xffffffff;
+}
+
+// the segment index is the time index, each segment is one contiguous run,
+// segments ending before from are not opened, the first sample is sought
+//
+uint8_t Sample::dumpFile(uint32_t from, uint32_t to, Session* first)
+{
+    closeFile();                                            // commit pending samples
+
+    if(segCount == 0)
+        return FLASH_FILE_ERROR;
+
+    char name[24];
+
+    for(uint8_t g=0; g<segCount && dPos<dLast; g++){
+        uint32_t e0 = toEpoch(&segs[g].session) + segs[g].time;
+
+        if(e0 >= to)
+            break;
+
+        if(g+1<segCount && toEpoch(&segs[g+1].session)+segs[g+1].time <= from)
+            continue;                                       // ends before window
+
+        segName(name, segs[g].seq, "bin");
+        int f = pico_open(name, LFS_O_RDONLY);
+
+        if(f < 0)                                           // dropped on reset
+            continue;
+
+        uint32_t i0, i1;
+
+        if(window(&segs[g].session, e0, pico_size(f) / SAMPLE_BYTES, from, to, &i0, &i1)){
+            dumpRun(&segs[g].session, segs[g].time + i0 * segs[g].session.interval, first);
+            pico_lseek(f, i0 * SAMPLE_BYTES, LFS_SEEK_SET);
+            dumpRead(f, i1 - i0);
+        }
+
+        pico_close(f);
+    }
+
+    return FLASH_OK;
+}
+
+// the sector headers are the time index, binary search for the last sector
+// starting at or before from, then reads linearly up to to
+//
+uint8_t Sample::dumpLog(uint32_t from, uint32_t to, Session* first)
+{
+    if(Store::isEmpty())
+        return FLASH_FILE_ERROR;
+
+    uint32_t lo = Store::getTail(), hi = Store::getHead();
+    LogHead h;
+
+    while(lo < hi){                                         // sessions in date order
+        uint32_t mid = (lo + hi + 1) / 2;
+        uint32_t seq = mid;
+
+        while(seq<=hi && !Store::readHead(seq, &h))        // skip damaged headers
+            seq++;
+
+        if(seq<=hi && toEpoch(&h.session)+h.time <= from)
+            lo = seq;
+        else
+            hi = mid - 1;
+    }
+
+    for(uint32_t seq=lo; seq<=Store::getHead() && dPos<dLast; seq++){
+        uint32_t count, valid, i0, i1;
+
+        if(!Store::readCount(seq, &h, &count))              // skip damaged sector
+            continue;
+
+        valid = count;
+
+        if(dPos+count>dFirst && !Store::read(seq, &h, &valid))  // samples checked only if sent
+            valid = 0;
+
+        uint32_t e0 = toEpoch(&h.session) + h.time;
+
+        if(e0 >= to)
+            break;
+
+        // positions advance by the count of the seal as cursor() counts
+        // them, samples after a damaged batch are left out
+        if(!window(&h.session, e0, count, from, to, &i0, &i1))
+            continue;
+
+        i1 = i1 < valid ? i1 : valid;
+
+        if(i0 >= i1)
+            continue;
+
+        dumpRun(&h.session, h.time + i0 * h.session.interval, first);
+
+        dumpWords(Store::samples(seq, i0, i1 - i0), i1 - i0);
+    }
+
+    return FLASH_OK;
+}
+
+// samples i0..i1-1 of a run of count starting at e0 lie in from <= t < to
+// and in dFirst <= n < dLast, n counting the samples of all runs passed
+//
+bool Sample::window(const Session* s, uint32_t e0, uint32_t count, uint32_t from, uint32_t to, uint32_t* i0, uint32_t* i1)
+{
+    uint32_t v = s->interval ? s->interval : 1;
+    uint32_t p = dPos;
+    dPos += count;
+
+    *i0 = from > e0 ? (from - e0 + v - 1) / v : 0;
+    *i1 = to > e0 ? (to - e0 + v - 1) / v : 0;
+    *i1 = *i1 < count ? *i1 : count;
+
+    if(dFirst > p)
+        *i0 = dFirst-p > *i0 ? dFirst-p : *i0;
+
+    if(dLast-p < *i1)
+        *i1 = dLast > p ? dLast-p : 0;
+
+    return *i0 < *i1;
+}
+
+// samples at time t of session s follow, a new session or a gap starts a run
+//
+void Sample::dumpRun(const Session* s, uint32_t t, Session* first)
+{
+    if(dSes.format && memcmp(s, &dSes, sizeof(Session))==0 && t==dNext)
+        return;
+
+    if(dStats || dReplay){                                  // no headers
+        dSkip = memcmp(s, &sketch.session, sizeof(Session)) != 0;
+        dSes = *s;
+        dNext = t;
+        return;
+    }
+
+    Session h = *s;
+    addTime(&h.dateYMD, &h.dateHMS, t);
+
+    if(dFactor > 1){                                        // tier records
+        h.interval *= dFactor;
+        h.channels *= tierWords();
+    }
+
+    if(dSes.format == 0)
+        *first = h;
+
+    tierEnd();
+    dumpFlush();                                            // lines before the header
+
+    if(dFrames)
+        Frame::send(FRAME_SESSION, &h, sizeof(Session));
+    else
+        printf("S %u %08u %06u %u %u %u\n", (unsigned)h.format, (unsigned)h.dateYMD, (unsigned)h.dateHMS,
+            (unsigned)h.interval, (unsigned)h.channels, (unsigned)h.bits);
+
+    dSes = *s;
+    dNext = t;
+}
+
+// n samples of file f from its position on, taken in place from flash
+// block by block, an inline file is read through buf
+//
+void Sample::dumpRead(int f, uint32_t n)
+{
+    uint16_t buf[FRAME_WORDS];
+
+    while(n){
+        const void* p;
+        lfs_ssize_t k = pico_map(f, &p, n * SAMPLE_BYTES) / SAMPLE_BYTES;
+
+        if(k <= 0){
+            k = n < FRAME_WORDS ? n : FRAME_WORDS;
+
+            if((lfs_ssize_t)pico_read(f, buf, k * SAMPLE_BYTES) != k * SAMPLE_BYTES)
+                return;
+
+            p = buf;
+        }
+
+        dumpWords((const uint16_t*)p, k);
+        n -= k;
+    }
+}
+
+// n samples at p, in flash or RAM, tiers take them into the record, full
+// lines are sent from p, only a partial line is copied to dBuf
+//
+void Sample::dumpWords(const uint16_t* p, uint32_t n)
+{
+    uint32_t t = dNext;
+    dNext += n * dSes.interval;
+
+    if(dReplay){
+        for(uint32_t i=0; !dSkip && i<n; i++)
+            addSketch(p[i], t + i * dSes.interval);
+
+        return;
+    }
+
+    if(dStats){
+        for(uint32_t i=0; i<n; i++){
+            uint16_t x = p[i];
+            dStats->min = x < dStats->min ? x : dStats->min;
+            dStats->max = x > dStats->max ? x : dStats->max;
+            dStats->sum += x;
+            dStats->squares += (uint32_t)x * x;
+        }
+
+        dStats->count += n;
+        return;
+    }
+
+    if(dFactor == 1){
+        dSize += n * SAMPLE_BYTES;
+
+        while(n){
+            if(dbi==0 && n>=dWidth){                        // full line in place
+                putLine(p, dWidth);
+                p += dWidth;
+                n -= dWidth;
+                continue;
+            }
+
+            uint16_t k = n < (uint32_t)(dWidth-dbi) ? n : dWidth-dbi;
+            memcpy(dBuf + dbi, p, k * SAMPLE_BYTES);
+            dbi += k;
+            p += k;
+            n -= k;
+
+            if(dbi == dWidth)
+                dumpLine();
+        }
+
+        return;
+    }
+
+    for(uint32_t i=0; i<n; i++){
+        if(tCount == 0)
+            tFirst = p[i];
+
+        Store::addZone(&tZone, p + i, 1);
+
+        if(++tCount == dFactor)
+            tierEnd();
+    }
+}
+
+// closes the tier record, a line takes the records that fit DUBLWI words
+//
+void Sample::tierEnd()
+{
+    if(tCount == 0)
+        return;
+
+    if(tMode == DECI_FIRST)
+        tBuf[tbi++] = tFirst;
+
+    if(tMode==DECI_TIER || tMode==DECI_MEAN)
+        tBuf[tbi++] = (tZone.sum + tCount / 2) / tCount;
+
+    if(tMode==DECI_TIER || tMode==DECI_MINMAX){
+        tBuf[tbi++] = tZone.min;
+        tBuf[tbi++] = tZone.max;
+    }
+
+    dSize += tierWords() * SAMPLE_BYTES;
+
+    tZone.min = 0xffff;
+    tZone.max = 0;
+    tZone.sum = 0;
+    tCount = 0;
+
+    if(tbi + tierWords() > DUBLWI)
+        dumpLine();
+}
+
+void Sample::dumpLine()
+{
+    uint16_t* b = dFactor>1 ? tBuf : dBuf;
+    uint16_t* n = dFactor>1 ? &tbi : &dbi;
+
+    if(*n == 0)
+        return;
+
+    putLine(b, *n);
+    *n = 0;
+}
+
+// a frame or a text line "0x%04x " per word, text is encoded into dOut by
+// table and written in bulk when full, one stdio call instead of a printf
+// per word
+//
+void Sample::putLine(const uint16_t* b, uint16_t n)
+{
+    static const char hex[] = "0123456789abcdef";
+
+    if(dFrames){
+        Frame::send(FRAME_DATA, b, n * SAMPLE_BYTES);
+        return;
+    }
+
+    if(doi + n * 7 + 1 > DUMP_OUT)
+        dumpOut();
+
+    char* p = dOut + doi;
+
+    for(uint16_t j=0; j<n; j++){
+        uint16_t x = b[j];
+        p[0] = '0';
+        p[1] = 'x';
+        p[2] = hex[x >> 12];
+        p[3] = hex[x >> 8 & 0xf];
+        p[4] = hex[x >> 4 & 0xf];
+        p[5] = hex[x & 0xf];
+        p[6] = ' ';
+        p += 7;
+    }
+
+    *p++ = '\n';
+    doi = p - dOut;
+}
+
+// the last line and the text kept in dOut
+//
+void Sample::dumpFlush()
+{
+    dumpLine();
+    dumpOut();
+}
+
+void Sample::dumpOut()
+{
+    if(doi == 0)
+        return;
+
+    fflush(stdout);                                         // printf before
+    write(STDOUT_FILENO, dOut, doi);
+    doi = 0;
+}
+
+// session start in seconds since 1970-01-01, dates taken as UTC
+//
+uint32_t Sample::toEpoch(const Session* s)
+{
+    uint32_t y = s->dateYMD / 10000;
+    uint32_t m = s->dateYMD / 100 % 100;
+    uint32_t d = s->dateYMD % 100;
+
+    y -= m <= 2;                                            // days from civil, march based year
+    uint32_t era = y / 400;
+    uint32_t yoe = y - era * 400;
+    uint32_t doy = (153 * (m > 2 ? m-3 : m+9) + 2) / 5 + d - 1;
+    uint32_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+    uint32_t days = era * 146097 + doe - 719468;
+
+    return days * 86400 + s->dateHMS / 10000 * 3600 + s->dateHMS / 100 % 100 * 60 + s->dateHMS % 100;
+}
+
+// adds seconds to a date, days per month and leap years
+//
+void Sample::addTime(uint32_t* ymd, uint32_t* hms, uint32_t seconds)
+{
+    static const uint8_t mdays[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+
+    uint32_t y = *ymd / 10000;
+    uint32_t m = *ymd / 100 % 100;
+    uint32_t d = *ymd % 100;
+    uint32_t s = *hms / 10000 * 3600 + *hms / 100 % 100 * 60 + *hms % 100 + seconds % 86400;
+    uint32_t days = seconds / 86400 + s / 86400;
+    s %= 86400;
+
+    m = m<1 ? 1 : m>12 ? 12 : m;
+
+    while(days--){
+        uint32_t n = mdays[m-1] + (m==2 && y%4==0 && (y%100!=0 || y%400==0));
+
+        if(++d > n){
+            d = 1;
+
+            if(++m > 12){
+                m = 1;
+                y++;
+            }
+        }
+    }
+
+    *ymd = y * 10000 + m * 100 + d;
+    *hms = s / 3600 * 10000 + s / 60 % 60 * 100 + s % 60;
+}
+
+// the samples of both stores go, the data file store may hold segments of
+// an earlier session or data.bin of older firmware whichever store is set
+//
+uint8_t Sample::remove()
+{
+    uint8_t err = FLASH_OK;
+
+    if(logStore)
+        err = Store::clear();
+
+    if(!mounted){
+        if(!logStore)
+            err = FLASH_MOUNT_ERROR;
+    }
+    else if(removeFiles()!=FLASH_OK && !logStore){
+        err = FLASH_FILE_ERROR;
+    }
+
+    time = 0;
+
+    Quantile::clear(&sketch.ses, session.dateYMD, session.dateHMS);     // quantiles go with the samples
+    Quantile::clear(&sketch.day, session.dateYMD, session.dateHMS);
+
+    if(session.format){                                     // session started
+        saveSketch();
+    }
+    else{
+        if(mounted)
+            pico_remove(SKETCH_FILE_NAME);
+
+        tailRam.magic = 0;
+    }
+
+    return err;
+}
+
+// segments in the index file by file, no copy, then files a reset left
+// between index and file updates, the empty index keeps the segment seq
+//
+uint8_t Sample::removeFiles()
+{
+    char name[sizeof(SAMPLE_DIR) + LFS_NAME_MAX + 1];
+    fileSize = 0;                                           // no zone map
+    closeFile();
+    pico_remove(LEGACY_FILE_NAME);
+
+    for(uint8_t g=0; g<segCount; g++){
+        segName(name, segs[g].seq, "bin");
+        pico_remove(name);
+        segName(name, segs[g].seq, "zon");
+        pico_remove(name);
+    }
+
+    segCount = 0;
+
+    for(bool found=true; found;){                           // rescan after each remove
+        struct lfs_info info;
+        int d = pico_dir_open(SAMPLE_DIR);
+        found = false;
+
+        if(d < 0)
+            break;
+
+        while(!found && pico_dir_read(d, &info) > 0){
+            found = info.type==LFS_TYPE_REG &&            // all but index.bin
+                strcmp(info.name, INDEX_FILE_NAME + sizeof(SAMPLE_DIR)) != 0;
+        }
+
+        pico_dir_close(d);
+
+        if(found){
+            sprintf(name, SAMPLE_DIR "/%s", info.name);
+
+            if(pico_remove(name) != LFS_ERR_OK)
+                break;
+        }
+    }
+
+    return saveIndex();
+}
+
+// sizes of the sample log and the file system, blocks used of the latter
+//
+uint8_t Sample::fsstat(struct pico_fsstat_t* st)
+{
+    if(!mounted)
+        return FLASH_MOUNT_ERROR;
+
+    pico_fsstat(st);
+    return FLASH_OK;
+}
+
+uint8_t Sample::format()
+{
+    uint8_t err = FLASH_OK;
+
+    if(mounted){
+        closeFile();
+        pico_unmount();
+    }
+
+    fileSize = 0;
+
+    if(pico_mount(true) != LFS_ERR_OK)                  // format flash
+        err = FLASH_FORMAT_ERROR;
+
+    mounted = err == FLASH_OK;
+    segCount = 0;
+    segNext = 0;
+
+    if(mounted)
+        pico_mkdir(SAMPLE_DIR);
+
+    if(Store::clear() != FLASH_OK)                      // and sample log
+        err = FLASH_FORMAT_ERROR;
+
+    time = 0;
+    memset(&sketch, 0, sizeof(SketchFile));
 
     return err;
 }
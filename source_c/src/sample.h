@@ -2,14 +2,42 @@
 
 #include "hardware/adc.h"
 #include "extra/pico_hal.h"
+#include "store.h"
+#include "quantile.h"
+#include "frame.h"
 
 #define ADC_PIN             26      // ADC0
+#define ADC_BITS            12
+#define SAMPLE_CHANNELS     1       // 2 byte words per sample record
 
-#define SAMPLE_FILE_NAME    "data.bin"
+#define SAMPLE_DIR          "data"                  // segment files 00000.bin ..
+#define INDEX_FILE_NAME     "data/index.bin"
+#define LEGACY_FILE_NAME    "data.bin"              // single data file of older firmware
+#define SKETCH_FILE_NAME    "sketch.bin"            // session and day quantile sketch, apart from
+                                                    // the data directory synced with every batch
+#define SKETCH_SAMPLES      4096    // flushed samples between sketch checkpoints
+#define SEGMENT_MAX         32      // segments in index
+#define SEGMENT_MIN         4096    // segment size in bytes, multiple of FLASH_SECTOR_SIZE
+#define SEGMENT_LIM         262144
+#define ZONE_BYTES          1024    // data segment block per zone map entry
+#define ZONE_SAMPLES        (ZONE_BYTES / SAMPLE_BYTES)
+#define TIER_MAX            4       // dump_tier up to 10^4 samples per record
+#define DECI_MAX            65536   // samples per decimated record, sum fits 32 bit
+#define DECI_TIER           0       // decimated record mean, min, max
+#define DECI_MEAN           1       //                  mean
+#define DECI_MINMAX         2       //                  min, max
+#define DECI_FIRST          3       //                  first sample
+#define TAIL_BYTES          4096    // newest samples in RAM kept over reset
+#define TAIL_SAMPLES        (TAIL_BYTES / SAMPLE_BYTES)
+#define TAIL_MAGIC          0x4c415470                  // "pTAL"
+#define FIND_SAMPLES        (FLASH_PAGE_SIZE / SAMPLE_BYTES)    // log block dumped by find
 
 #define BLOCKS_MIN_FREE     2
 #define DUBLWI              16      // dump block width in 2 byte words
+#define DUMP_OUT            1024    // text dump output buffer in bytes, written at once
 #define SAMPLE_BYTES        2       // 2 byte word
+#define BATCH_MIN           256     // RAM batch in bytes, FLASH_PAGE_SIZE
+#define BATCH_MAX           4096    //                     FLASH_SECTOR_SIZE
 
 #define FLASH_OK            0
 #define FLASH_FULL_ERROR    1
@@ -17,18 +45,182 @@
 #define FLASH_FILE_ERROR    3
 #define FLASH_FORMAT_ERROR  4
 
+typedef struct Segment{
+    uint32_t seq;                   // file name number
+    uint32_t time;                  // first sample, seconds since session start
+    Session session;
+}Segment;
+
+// aggregates of the samples in a time range, integer accumulators, mean
+// and standard deviation in hundredths
+//
+typedef struct Stats{
+    uint32_t count;
+    uint16_t min;
+    uint16_t max;
+    uint32_t mean;                  // * 100
+    uint32_t stddev;                // * 100, population
+    uint64_t sum;
+    uint64_t squares;               // sum of squared samples
+}Stats;
+
+// payload of the FRAME_END of a binary dump
+//
+typedef struct FrameEnd{
+    uint32_t err;                   // FLASH_OK ..
+    int32_t size;                   // sample bytes dumped
+    Session first;                  // date of the first sample, format 0 none
+}FrameEnd;
+
+// sync cursor, a sample is addressed by the seq of its log sector or data
+// segment and its index in it, seqs are not reused when the oldest are
+// dropped or the samples removed, so a cursor stays valid while samples
+// are added
+//
+typedef struct Cursor{
+    uint32_t count;                 // samples stored
+    uint32_t offset;                // byte offset of the cursor asked for, as dump_from counts
+    uint32_t seq;                   // after the newest sample, sector or segment seq
+    uint32_t index;                 //                          sample index in it
+    uint32_t gap;                   // 1 cursor asked for not stored, offset 0
+}Cursor;
+
+// newest samples of the session in RAM that is not cleared on reset, valid
+// while the header crc holds, lost on power loss
+//
+typedef struct Tail{
+    uint32_t magic;                 // TAIL_MAGIC
+    Session session;
+    uint32_t time;                  // next sample, seconds since session start
+    uint32_t count;                 // samples in buf, up to TAIL_SAMPLES
+    uint32_t head;                  // next one goes here
+    uint32_t crc;                   // crc32 of header up to crc
+    uint16_t buf[TAIL_SAMPLES];
+}Tail;
+
+// quantile sketches of a session and of its current day as stored, the
+// samples of the session from time on are replayed from the store on load
+//
+typedef struct SketchFile{
+    Session session;
+    uint32_t time;                  // next sample not in the sketches, seconds since session start
+    uint32_t dayEnd;                // first second of the next day
+    Sketch ses;
+    Sketch day;
+}SketchFile;
+
 class Sample
 {
     public:
         static uint8_t init();
+        static uint8_t import(uint32_t ymd, uint32_t hms, uint32_t interval);
         static uint8_t sample();
-        static uint8_t dump(int32_t* size);
+        static uint8_t start(uint32_t ymd, uint32_t hms);
+        static uint8_t dump(uint32_t from, uint32_t to, int32_t* size, Session* first);
+        static uint8_t dumpBin(uint32_t first, int32_t* size, Session* ses);
+        static uint8_t dumpFrom(uint32_t offset, uint32_t len, int32_t* size, Session* first);
+        static uint8_t dumpTier(uint8_t n, int32_t* size, Session* first);
+        static uint8_t dumpDeci(uint8_t mode, uint32_t n, int32_t* size, Session* first);
+        static uint8_t cursor(uint32_t seq, uint32_t index, Cursor* c);
+        static uint8_t tail(uint32_t n, int32_t* size, Session* first);
+        static uint8_t stats(uint32_t from, uint32_t to, Stats* st);
+        static uint8_t quantiles(Sketch* ses, Sketch* day);
+        static uint8_t find(bool below, uint16_t x, int32_t* size, Session* first);
+        static uint32_t toEpoch(const Session* s);
         static uint8_t remove();
         static uint8_t format();
-        static void setBufSize(uint8_t size);
+        static uint8_t fsstat(struct pico_fsstat_t* st);
+        static void setBatch(uint16_t bytes, uint32_t maxUnsaved);
+        static uint16_t getBatchSamples() { return sBufSize<maxUnsaved ? sBufSize : maxUnsaved; }
+        static void setSync(uint8_t flushes) { syncFlushes = flushes ? flushes : 1; }
+        static void setSegment(uint32_t bytes);
+        static void setStore(bool log) { logStore = log; }
+        static void setRing(bool v) { ring = v; Store::setRing(v); }
+        static void setInterval(uint32_t v) { interval = v; }
 
     private:
         static uint16_t* sBuf;          // sample buffer
-        static uint8_t sBufSize;        //               size  in 2 byte words
-        static uint8_t sbi;             //               index
+        static uint16_t sBufSize;       //               size  in 2 byte words
+        static uint16_t sbi;            //               index
+        static uint32_t maxUnsaved;     // samples not committed to flash, max
+        static uint32_t unsaved;        //                                 now
+        static uint32_t fileSize;       // segment bytes incl. written buffers
+        static uint32_t segBytes;       //         size where the next one starts
+        static Segment segs[SEGMENT_MAX];   // index, oldest first
+        static Zone zones[SEGMENT_LIM / ZONE_BYTES];    // zone map of newest segment
+        static uint8_t segCount;
+        static uint32_t segNext;        // seq of the next segment, kept in the index over remove
+        static bool ring;               // drop oldest segment when full
+
+        static bool logStore;           // raw flash sample log instead of data file
+        static uint32_t interval;       // seconds
+        static Session session;         // current sampling session
+        static uint32_t time;           // next sample, seconds since session start
+        static uint32_t bufTime;        //      first in buffer
+        static SketchFile sketch;       // quantiles of session and day
+
+        static bool mounted;            // file system mounted once in init()
+        static int file;                // newest segment, kept open while sampling, <0 closed
+        static uint8_t syncFlushes;     // buffer flushes per file sync
+        static uint8_t unsynced;        //                not yet synced
+
+        static uint16_t dBuf[FRAME_WORDS];  // dump line, partial, full lines are sent in place
+        static uint16_t dbi;            //           index
+        static char dOut[DUMP_OUT];     //      text output
+        static uint16_t doi;            //           index
+        static uint16_t dWidth;         //      line words, DUBLWI or FRAME_WORDS
+        static bool dFrames;            //      binary frames instead of text
+        static uint32_t dPos;           //      samples of all runs passed
+        static uint32_t dFirst;         //      dump samples dFirst <= n < dLast only
+        static uint32_t dLast;
+        static Session dSes;            //      session of current run, format 0 none
+        static uint32_t dNext;          //      time of next sample in run
+        static int32_t dSize;           //      bytes
+        static uint32_t dFactor;        //      samples per tier record, 1 raw
+        static Zone tZone;              // tier record
+        static uint32_t tCount;         //           samples
+        static uint8_t tMode;           //           DECI_TIER ..
+        static uint16_t tFirst;         //           first sample
+        static uint16_t tBuf[DUBLWI];   //           line
+        static uint16_t tbi;            //           index
+        static Stats* dStats;           // stats() accumulates instead of dumping
+        static bool dReplay;            // loadSketch() adds to the sketches
+        static bool dSkip;              //              run of another session
+
+        static void closeFile();
+        static void segName(char* name, uint32_t seq, const char* ext);
+        static uint8_t saveZones();
+        static uint8_t loadIndex();
+        static uint8_t saveIndex();
+        static uint8_t loadSketch();
+        static uint8_t saveSketch();
+        static void addSketch(uint16_t x, uint32_t t);
+        static void addTail(uint16_t x);
+        static uint32_t tailCrc();
+        static uint8_t newSegment(uint32_t t);
+        static uint8_t dropSegment();
+        static uint8_t removeFiles();
+        static uint8_t save(bool due);
+        static uint8_t saveLog();
+        static uint8_t dumpFile(uint32_t from, uint32_t to, Session* first);
+        static uint8_t dumpLog(uint32_t from, uint32_t to, Session* first);
+        static uint8_t findFile(bool below, uint16_t x, Session* first);
+        static uint8_t findLog(bool below, uint16_t x, Session* first);
+        static bool match(const Zone* z, bool below, uint16_t x);
+        static void dumpBegin(Session* first);
+        static uint8_t dumpAll(uint32_t from, uint32_t to, uint32_t factor, uint8_t mode, bool frames, int32_t* size, Session* first);
+        static uint8_t tierWords() { return tMode==DECI_TIER ? 3 : tMode==DECI_MINMAX ? 2 : 1; }
+        static void tierEnd();
+        static void cursorAt(Cursor* c, uint32_t seq, uint32_t count, uint32_t s, uint32_t i);
+        static void frameEnd(uint8_t err, int32_t size, const Session* first);
+        static bool window(const Session* s, uint32_t e0, uint32_t count, uint32_t from, uint32_t to, uint32_t* i0, uint32_t* i1);
+        static void dumpRun(const Session* s, uint32_t t, Session* first);
+        static void dumpRead(int f, uint32_t n);
+        static void dumpWords(const uint16_t* p, uint32_t n);
+        static void dumpLine();
+        static void putLine(const uint16_t* b, uint16_t n);
+        static void dumpFlush();
+        static void dumpOut();
+        static uint32_t isqrt(uint64_t x);
+        static void addTime(uint32_t* ymd, uint32_t* hms, uint32_t seconds);
 };
@@ -0,0 +1,420 @@
+#include <stddef.h>
+#include <string.h>
+#include "store.h"
+
+#define ENTRY_OFF(k)    (FLASH_SECTOR_SIZE - LOG_SEAL_BYTES - ((k) + 1) * LOG_ENTRY_BYTES)
+#define SEAL_OFF        (FLASH_SECTOR_SIZE - LOG_SEAL_BYTES)
+
+uint32_t Store::sectors;
+bool Store::ring;
+Session Store::session;
+bool Store::empty = true;
+uint32_t Store::head;
+uint32_t Store::tail;
+LogHead Store::last;
+bool Store::open;
+uint32_t Store::fill;
+uint32_t Store::entries;
+uint32_t Store::sum;
+uint8_t Store::page[FLASH_PAGE_SIZE];
+
+static const uint32_t crcTab[16] = {                    // crc32 0xedb88320, nibble wise
+    0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+    0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c
+};
+
+uint32_t Store::crc32(uint32_t crc, const void* data, uint32_t size)
+{
+    const uint8_t* p = (const uint8_t*)data;
+    crc = ~crc;
+
+    while(size--){
+        crc = crcTab[(crc ^ *p) & 0x0f] ^ (crc >> 4);
+        crc = crcTab[(crc ^ (*p++ >> 4)) & 0x0f] ^ (crc >> 4);
+    }
+
+    return ~crc;
+}
+
+// finds the newest sector, sector i holds seq s0+i up to the head and older
+// or no sectors behind it, so the head is the last i where this holds,
+// an open head takes further appends if no batch was torn
+//
+uint8_t Store::init()
+{
+    LogHead h;
+    sectors = pico_log_size() / FLASH_SECTOR_SIZE;
+    empty = true;
+    open = false;
+
+    if(readAt(0, &h)){
+        uint32_t s0 = h.seq;
+        uint32_t lo = 0, hi = sectors - 1;
+
+        while(lo < hi){
+            uint32_t mid = (lo + hi + 1) / 2;
+
+            if(readAt(mid, &h) && h.seq==s0+mid)
+                lo = mid;
+            else
+                hi = mid - 1;
+        }
+
+        readAt(lo, &last);
+        empty = false;
+    }
+    else if(readAt(sectors-1, &last)){                  // sector 0 torn on wrap
+        empty = false;
+    }
+
+    if(empty)
+        return FLASH_OK;
+
+    head = last.seq;
+    tail = head+1 >= sectors ? head+1-sectors : 0;      // oldest possible
+    tail = last.base > tail ? last.base : tail;
+
+    uint32_t sector = head % sectors;
+    LogSeal s;
+    pico_log_read(sector * FLASH_SECTOR_SIZE + SEAL_OFF, &s, LOG_SEAL_BYTES);
+
+    if(s.count == 0xffffffff){                          // not sealed
+        open = true;                                    // seal() needs it
+        bool ok = scan(sector, &fill, &entries, &sum);
+
+        if(!ok || !isClean(sector, fill, entries))      // torn batch, close
+            return seal();
+    }
+    else{
+        read(head, &h, &fill);
+    }
+
+    return FLASH_OK;
+}
+
+// a new session closes the newest sector unless it is still empty and of
+// the same session, its samples follow in a new sector
+//
+uint8_t Store::begin(const Session* s)
+{
+    bool same = memcmp(&last.session, s, sizeof(Session)) == 0;
+    session = *s;
+
+    if(open && (fill || !same))
+        return seal();
+
+    return FLASH_OK;
+}
+
+// appends a batch to the newest sector, opens further sectors as needed,
+// a full log keeps the samples written so far
+//
+uint8_t Store::write(const uint16_t* buf, uint16_t count, uint32_t time)
+{
+    uint8_t err;
+
+    if(open && time!=last.time+fill*session.interval){     // gap, dropped samples
+        if((err = seal()) != FLASH_OK)
+            return err;
+    }
+
+    for(uint32_t done=0; done<count;){
+        int32_t room = open ? ((int32_t)ENTRY_OFF(entries) - (int32_t)(LOG_HEAD_BYTES + fill * 2)) / 2 : 0;
+
+        if(room <= 0){
+            if((err = seal()) != FLASH_OK)
+                return err;
+
+            uint32_t seq = empty ? 0 : head + 1;
+
+            if((err = openSector(seq, empty ? seq : last.base, time + done * session.interval)) != FLASH_OK)
+                return err;
+
+            continue;
+        }
+
+        uint32_t n = count-done < (uint32_t)room ? count-done : room;
+        uint32_t off = head % sectors * FLASH_SECTOR_SIZE;
+        LogEntry e;
+
+        e.count = n;
+        e.crc = crc32(crc32(0, &e.count, sizeof(e.count)), buf + done, n * 2) & 0xffff;
+
+        if((err = prog(off + LOG_HEAD_BYTES + fill * 2, buf + done, n * 2)) != FLASH_OK)
+            return err;
+
+        if((err = prog(off + ENTRY_OFF(entries), &e, LOG_ENTRY_BYTES)) != FLASH_OK)
+            return err;
+
+        sum = crc32(sum, buf + done, n * 2);
+        fill += n;
+        entries++;
+        done += n;
+    }
+
+    return FLASH_OK;
+}
+
+// starts a new log in a new sector, older sectors are skipped from now
+//
+uint8_t Store::clear()
+{
+    if(empty || (open && fill==0 && last.base==head))       // nothing logged
+        return FLASH_OK;
+
+    uint8_t err = seal();
+
+    if(err == FLASH_OK)
+        err = openSector(head + 1, head + 1, 0);
+
+    return err;
+}
+
+// reads and checks the header and sample count of sector seq
+//
+bool Store::read(uint32_t seq, LogHead* h, uint32_t* count)
+{
+    if(!readHead(seq, h))
+        return false;
+
+    uint32_t sector = seq % sectors;
+
+    if(seq==head && open){
+        *count = fill;
+        return true;
+    }
+
+    LogSeal s;
+    pico_log_read(sector * FLASH_SECTOR_SIZE + SEAL_OFF, &s, LOG_SEAL_BYTES);
+
+    if(s.count <= LOG_SAMPLES){
+        uint32_t c = crc32(0, samples(seq, 0, s.count), s.count * 2);
+
+        if(crc32(c, &s.count, sizeof(s.count)) == s.crc){
+            *count = s.count;
+            return true;
+        }
+    }
+
+    uint32_t batches, c;                                // seal torn, use the batches
+    scan(sector, count, &batches, &c);
+
+    return true;
+}
+
+// header and sample count of sector seq, the count is taken from the seal
+// trusted by its check as readZone does, the samples are not read, an
+// open sector or a torn seal is counted as read() does
+//
+bool Store::readCount(uint32_t seq, LogHead* h, uint32_t* count)
+{
+    if(!readHead(seq, h))
+        return false;
+
+    uint32_t sector = seq % sectors;
+
+    if(seq==head && open){
+        *count = fill;
+        return true;
+    }
+
+    LogSeal s;
+    pico_log_read(sector * FLASH_SECTOR_SIZE + SEAL_OFF, &s, LOG_SEAL_BYTES);
+
+    if(crc32(0, &s, offsetof(LogSeal, check))==s.check && s.count<=LOG_SAMPLES){
+        *count = s.count;
+        return true;
+    }
+
+    uint32_t batches, c;
+    scan(sector, count, &batches, &c);
+
+    return true;
+}
+
+// header only, no check of the samples
+//
+bool Store::readHead(uint32_t seq, LogHead* h)
+{
+    return !empty && seq>=tail && seq<=head && readAt(seq % sectors, h) && h->seq==seq;
+}
+
+// zone map of a sealed sector, false if open or the seal is torn
+//
+bool Store::readZone(uint32_t seq, Zone* z)
+{
+    LogSeal s;
+    pico_log_read(seq % sectors * FLASH_SECTOR_SIZE + SEAL_OFF, &s, LOG_SEAL_BYTES);
+
+    if(crc32(0, &s, offsetof(LogSeal, check))!=s.check || s.count>LOG_SAMPLES)
+        return false;
+
+    *z = s.zone;
+    return true;
+}
+
+// merges count samples into z, start with min 0xffff, max 0, sum 0
+//
+void Store::addZone(Zone* z, const uint16_t* buf, uint32_t count)
+{
+    for(uint32_t i=0; i<count; i++){
+        z->min = buf[i] < z->min ? buf[i] : z->min;
+        z->max = buf[i] > z->max ? buf[i] : z->max;
+        z->sum += buf[i];
+    }
+}
+
+// samples first.. of sector seq in flash, contiguous, not copied
+//
+const uint16_t* Store::samples(uint32_t seq, uint32_t first, uint32_t count)
+{
+    return (const uint16_t*)pico_log_map(seq % sectors * FLASH_SECTOR_SIZE + LOG_HEAD_BYTES + first * 2, count * 2);
+}
+
+bool Store::readAt(uint32_t sector, LogHead* h)
+{
+    pico_log_read(sector * FLASH_SECTOR_SIZE, h, LOG_HEAD_BYTES);
+
+    return h->magic==LOG_MAGIC && h->seq%sectors==sector && crc32(0, h, offsetof(LogHead, crc))==h->crc;
+}
+
+// walks the batch entries of a sector, returns false at a torn batch,
+// count, batches and crc32 cover the intact batches before
+//
+bool Store::scan(uint32_t sector, uint32_t* count, uint32_t* batches, uint32_t* crc)
+{
+    uint32_t off = sector * FLASH_SECTOR_SIZE;
+    *count = 0;
+    *batches = 0;
+    *crc = 0;
+
+    while(true){
+        LogEntry e;
+        uint32_t eoff = ENTRY_OFF(*batches);
+
+        if(eoff < LOG_HEAD_BYTES + *count * 2)
+            return true;
+
+        pico_log_read(off + eoff, &e, LOG_ENTRY_BYTES);
+
+        if(e.count==0xffff && e.crc==0xffff)            // erased, end of batches
+            return true;
+
+        if(e.count==0 || LOG_HEAD_BYTES+(*count+e.count)*2 > eoff)
+            return false;
+
+        const void* buf = pico_log_map(off + LOG_HEAD_BYTES + *count * 2, e.count * 2);
+        uint32_t c = crc32(crc32(0, &e.count, sizeof(e.count)), buf, e.count * 2);
+        uint32_t s = crc32(*crc, buf, e.count * 2);
+
+        if((c & 0xffff) != e.crc)
+            return false;
+
+        *count += e.count;
+        *crc = s;
+        (*batches)++;
+    }
+}
+
+// true if the bytes between samples and batch entries are still erased
+//
+bool Store::isClean(uint32_t sector, uint32_t count, uint32_t batches)
+{
+    uint32_t i = LOG_HEAD_BYTES + count * 2, n = ENTRY_OFF(batches) + LOG_ENTRY_BYTES;
+
+    if(n <= i)                                          // full
+        return true;
+
+    const uint8_t* buf = (const uint8_t*)pico_log_map(sector * FLASH_SECTOR_SIZE + i, n - i);
+
+    for(uint32_t j=0; j<n-i; j++)
+        if(buf[j] != 0xff)
+            return false;
+
+    return true;
+}
+
+// erases the sector of seq and programs its header, if it holds the
+// oldest sector of the current log it fails or in ring mode drops it
+//
+uint8_t Store::openSector(uint32_t seq, uint32_t base, uint32_t time)
+{
+    if(!ring && !empty && base!=seq && seq-tail>=sectors)
+        return FLASH_FULL_ERROR;
+
+    LogHead h;
+    uint32_t off = seq % sectors * FLASH_SECTOR_SIZE;
+
+    h.magic = LOG_MAGIC;
+    h.seq = seq;
+    h.base = base;
+    h.time = time;
+    h.session = session;
+    h.crc = crc32(0, &h, offsetof(LogHead, crc));
+
+    if(pico_log_erase(off) != LFS_ERR_OK)
+        return FLASH_FILE_ERROR;
+
+    uint8_t err = prog(off, &h, LOG_HEAD_BYTES);
+
+    if(err != FLASH_OK)
+        return err;
+
+    last = h;
+    head = seq;
+    tail = seq+1 >= sectors ? seq+1-sectors : 0;        // oldest left
+    tail = base > tail ? base : tail;
+    empty = false;
+    open = true;
+    fill = 0;
+    entries = 0;
+    sum = 0;
+
+    return FLASH_OK;
+}
+
+// commit marker, the sector takes no further batches, its zone map is read
+// back from flash once
+//
+uint8_t Store::seal()
+{
+    if(!open)
+        return FLASH_OK;
+
+    LogSeal s;
+    s.count = fill;
+    s.crc = crc32(sum, &s.count, sizeof(s.count));
+    s.zone.min = 0xffff;
+    s.zone.max = 0;
+    s.zone.sum = 0;
+
+    addZone(&s.zone, samples(head, 0, fill), fill);
+    s.check = crc32(0, &s, offsetof(LogSeal, check));
+    open = false;
+
+    return prog(head % sectors * FLASH_SECTOR_SIZE + SEAL_OFF, &s, LOG_SEAL_BYTES);
+}
+
+// programs bytes into erased flash, the rest of each page is left 0xff
+//
+uint8_t Store::prog(uint32_t off, const void* data, uint32_t size)
+{
+    const uint8_t* p = (const uint8_t*)data;
+
+    while(size){
+        uint32_t po = off % FLASH_PAGE_SIZE;
+        uint32_t n = size < FLASH_PAGE_SIZE-po ? size : FLASH_PAGE_SIZE-po;
+
+        memset(page, 0xff, sizeof(page));
+        memcpy(page + po, p, n);
+
+        if(pico_log_prog(off - po, page, sizeof(page)) != LFS_ERR_OK)
+            return FLASH_FILE_ERROR;
+
+        off += n;
+        p += n;
+        size -= n;
+    }
+
+    return FLASH_OK;
+}
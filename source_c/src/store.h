@@ -0,0 +1,114 @@
+#pragma once
+
+#include "hardware/flash.h"
+#include "extra/pico_hal.h"
+
+#define LOG_MAGIC           0x324f4c70                  // "pLO2", LogSeal with Zone
+#define SESSION_FORMAT      1                           // sample record layout
+#define LOG_HEAD_BYTES      sizeof(LogHead)
+#define LOG_SEAL_BYTES      sizeof(LogSeal)
+#define LOG_ENTRY_BYTES     sizeof(LogEntry)
+#define LOG_SAMPLES         ((FLASH_SECTOR_SIZE - LOG_HEAD_BYTES - LOG_SEAL_BYTES - LOG_ENTRY_BYTES) / 2)
+
+#define FLASH_OK            0
+#define FLASH_FULL_ERROR    1
+#define FLASH_MOUNT_ERROR   2
+#define FLASH_FILE_ERROR    3
+#define FLASH_FORMAT_ERROR  4
+
+// sector layout
+//   LogHead    programmed when the sector is opened
+//   samples    appended batch by batch into erased bytes, growing up
+//   LogEntry   one per batch, programmed after its samples, growing down
+//   LogSeal    commit marker with the zone map of the sector, programmed
+//              when the sector is closed
+
+// describes a sampling session, stored with every log sector and data
+// segment so appended sessions keep their own timestamps
+//
+typedef struct Session{
+    uint32_t dateYMD;                       // session start yyyymmdd
+    uint32_t dateHMS;                       //                hhmmss
+    uint32_t interval;                      // seconds between samples
+    uint8_t channels;                       // 2 byte words per sample record
+    uint8_t bits;                           // ADC resolution
+    uint16_t format;                        // SESSION_FORMAT
+}Session;
+
+typedef struct LogHead{
+    uint32_t magic;                         // LOG_MAGIC
+    uint32_t seq;                           // sector sequence number, in sector seq % sectors
+    uint32_t base;                          // seq of the first sector of this log
+    uint32_t time;                          // first sample, seconds since session start
+    Session session;
+    uint32_t crc;                           // crc32 of header up to crc
+}LogHead;
+
+// summary of a block of samples, queries skip blocks that cannot match
+//
+typedef struct Zone{
+    uint16_t min;
+    uint16_t max;
+    uint32_t sum;
+}Zone;
+
+typedef struct LogEntry{
+    uint16_t count;                         // samples in batch, 0xffff erased
+    uint16_t crc;                           // crc32 of count and samples, low half
+}LogEntry;
+
+typedef struct LogSeal{
+    uint32_t count;                         // samples in sector, 0xffffffff open
+    uint32_t crc;                           // crc32 of samples and count
+    Zone zone;                              // of all samples
+    uint32_t check;                         // crc32 of count and zone, valid without the samples
+}LogSeal;
+
+// append only sample log on raw flash, sectors are written in sequence and
+// wrap around the region, the newest is found by binary search over the
+// sequence numbers, batches are appended without read-modify-write, in
+// ring mode the oldest sector is dropped when a new one is needed, the
+// samples of a sector are contiguous in time so its header indexes them
+//
+class Store
+{
+    public:
+        static uint8_t init();
+        static uint8_t begin(const Session* s);
+        static uint8_t write(const uint16_t* buf, uint16_t count, uint32_t time);
+        static uint8_t clear();
+        static bool read(uint32_t seq, LogHead* h, uint32_t* count);
+        static bool readCount(uint32_t seq, LogHead* h, uint32_t* count);
+        static bool readHead(uint32_t seq, LogHead* h);
+        static bool readZone(uint32_t seq, Zone* z);
+        static const uint16_t* samples(uint32_t seq, uint32_t first, uint32_t count);
+        static uint32_t crc32(uint32_t crc, const void* data, uint32_t size);
+        static void addZone(Zone* z, const uint16_t* buf, uint32_t count);
+
+        static void setRing(bool v) { ring = v; }
+        static bool isEmpty() { return empty; }
+        static uint32_t getHead() { return head; }
+        static uint32_t getTail() { return tail; }
+        static uint32_t getPos() { return open ? LOG_HEAD_BYTES + fill * 2 : LOG_HEAD_BYTES; }
+
+    private:
+        static uint32_t sectors;            // in log region
+        static bool ring;                   // reuse the oldest sector when full
+        static Session session;             // written into new sector headers
+        static bool empty;                  // no valid sector
+        static uint32_t head;               // seq of newest sector
+        static uint32_t tail;               //        oldest
+        static LogHead last;                // header of newest sector
+        static bool open;                   //           newest sector takes appends
+        static uint32_t fill;               //           samples
+        static uint32_t entries;            //           batches
+        static uint32_t sum;                //           crc32 of samples
+        static uint8_t page[FLASH_PAGE_SIZE];
+
+        static bool readAt(uint32_t sector, LogHead* h);
+        static bool scan(uint32_t sector, uint32_t* count, uint32_t* batches, uint32_t* crc);
+        static bool isClean(uint32_t sector, uint32_t count, uint32_t batches);
+        static uint8_t openSector(uint32_t seq, uint32_t base, uint32_t time);
+        static uint8_t seal();
+        static uint8_t prog(uint32_t off, const void* data, uint32_t size);
+};
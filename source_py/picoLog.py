@@ -1,7 +1,7 @@
 # picoLog.py V0.8 221112 qrt@qland.de
 
-import os, serial, time
-from datetime import datetime
+import os, serial, serial.tools.list_ports, time, calendar, struct, zlib, json
+from datetime import datetime, timedelta
 from matplotlib import pyplot as plt, dates
 import matplotlib.ticker as ticker
 import pandas as pd
@@ -11,6 +11,9 @@ DUMPFILE = 'dumpfile.dat'                                       # path and filen
 XTICK_FREQU = 2                                                 # xtick freuqency in hours
 XTICK_FORMAT = '%H:%M:%S'                                       #       format
 AVS = 10                                                        # average sample factor
+CHUNK = 16384                                                   # bytes per dump_from request
+SYNCFILE = 'sync.json'                                          # last synced cursor per Pico
+ARCHIVE = 'archive_{}.dat'                                      # samples of all syncs, per Pico
 
 ser = 0
 
@@ -22,28 +25,39 @@ def logVis():
         return
 
     file = open(DUMPFILE, "r")                                  # open dump file
-    osam = []                                                   # original samples
+    runs = []                                                   # session runs [date time, interval, channels, samples]
     dtin = []                                                   # date, time, interval, num words
 
     for line in file:
         if line.startswith('0x'):
-            osam.extend([int(s[2:], 16) for s in line.split()])
-        elif len(dtin) == 0:
+            if len(runs) == 0:                                  # dump without session headers
+                runs.append([None, 0, 1, []])
+            runs[-1][3].extend([int(s[2:], 16) for s in line.split()])
+        elif line.startswith('S '):                             # S format date time interval channels bits
+            head = line.split()
+            runs.append([datetime.strptime(head[2] + head[3], '%Y%m%d%H%M%S'), int(head[4]), int(head[5]), []])
+        elif len(line.strip()) and len(dtin) == 0:
             dtin = line.split()                                
 
     file.close()
 
     # - - - - - - - - - - - - - - - - - - - -
 
-    dati = datetime.strptime(dtin[0] + dtin[1], '%Y%m%d%H%M%S') # get date and time
-    interval = int(dtin[2])                                     #     sample interval
+    stim = []                                                   # averaged sample times
+    asam = []                                                   #                  values
 
-    asam = [ int(sum(osam[i:i+AVS])/AVS) for i in range(0, int(len(osam)/AVS)*AVS, AVS) ]       # averaged samples
+    for dati, interval, channels, osam in runs:
+        if dati is None:                                        # date and time of dump trailer
+            dati = datetime.strptime(dtin[0] + dtin[1], '%Y%m%d%H%M%S')
+            interval = int(dtin[2])
 
-    # - - - - - - - - - - - - - - - - - - - -
+        osam = osam[::channels]                                 # tier dump, mean of mean min max
+
+        n = int(len(osam)/AVS)
+        asam.extend([ int(sum(osam[i*AVS:i*AVS+AVS])/AVS) for i in range(n) ])
+        stim.extend(list(pd.date_range(dati, freq=pd.to_timedelta(interval*AVS, 'S'), periods=n)))
 
-    dt = datetime.strftime(dati, '%Y-%m-%d %H:%M:%S')           # for use in DataFrame
-    df = pd.DataFrame(dict(time=list(pd.date_range(dt, freq=pd.to_timedelta(interval*AVS, 'S'), periods=len(asam))), bright=asam))
+    df = pd.DataFrame(dict(time=stim, bright=asam))
 
     # - - - - - - - - - - - - - - - - - - - -
 
@@ -84,7 +98,7 @@ def sample():
 
 #-------------------------------------------------------------------------------
 
-def dump():    
+def dump(cmd='dump 0'):    
     try:
         file = open(DUMPFILE, 'w')
     except:
@@ -92,7 +106,7 @@ def dump():
         exit(1)
 
     print('dumping ...')
-    ser.write(b'dump 0\n')
+    ser.write(bytes(cmd + '\n', 'utf-8'))
     n = 0
 
     while(True):
@@ -110,6 +124,376 @@ def dump():
 
 #-------------------------------------------------------------------------------
 
+def cobsDecode(data):
+    out = bytearray()
+    i = 0
+
+    while i < len(data):
+        code = data[i]
+        if code == 0 or i + code > len(data): return None
+        out += data[i+1:i+code]
+        i += code
+        if code < 0xff and i < len(data): out.append(0)        # implied zero
+
+    return bytes(out)
+
+def readFrame():                                                # (type, seq, payload), 'bad' or None on timeout
+    raw = ser.read_until(b'\x00')
+    if len(raw) == 0 or raw[-1] != 0: return None
+
+    f = cobsDecode(raw[:-1])
+    if f is None or len(f) < 11: return 'bad'
+
+    typ, seq, n = struct.unpack('<BIH', f[:7])
+    if n != len(f) - 11 or zlib.crc32(f[:-4]) != struct.unpack('<I', f[-4:])[0]: return 'bad'
+
+    return (chr(typ), seq, f[7:-4])
+
+def dumpBin():
+    print('dumping binary ...')
+    frames = []                                                 # verified, in seq order
+    end = None
+
+    for attempt in range(10):                                   # request again from first damaged frame
+        ser.reset_input_buffer()
+        ser.write(bytes('dump_bin {}\n'.format(len(frames)), 'utf-8'))
+        ok = True
+
+        while True:
+            fr = readFrame()
+            if fr is None: break                                # timeout
+
+            if ok and fr != 'bad' and fr[1] == len(frames):
+                frames.append(fr)
+                print('\r' + str(len(frames)), end='', flush=True)
+                if fr[0] == 'E':
+                    end = fr
+                    break
+            else:                                               # drain up to the end of this pass
+                ok = False
+                if fr != 'bad' and fr[0] == 'E': break
+
+        if end: break
+        print(' frame {} damaged, again'.format(len(frames)))
+
+    if not end:
+        print(' error: dump failed')
+        return
+
+    try:
+        file = open(DUMPFILE, 'w')
+    except:
+        print('error: cant write dumpfile')
+        exit(1)
+
+    for typ, seq, pay in frames:                                # same text as dump()
+        if typ == 'S':
+            ymd, hms, interval, channels, bits, fmt = struct.unpack('<IIIBBH', pay)
+            file.write('S {} {:08} {:06} {} {} {}\n'.format(fmt, ymd, hms, interval, channels, bits))
+        elif typ == 'D':
+            words = struct.unpack('<{}H'.format(len(pay)//2), pay)
+            for i in range(0, len(words), 16):
+                file.write(' '.join('0x{:04x}'.format(w) for w in words[i:i+16]) + '\n')
+
+    err, size = struct.unpack('<Ii', end[2][:8])
+    ymd, hms, interval = struct.unpack('<III', end[2][8:20])
+    file.write('\n{:08} {:06} {:06} {}\n'.format(ymd, hms, interval, size//2))
+    file.close()
+
+    print(' OK' if err == 0 else ' error: {}'.format(err))
+
+#-------------------------------------------------------------------------------
+
+def fetch(file, state, end=None, part=None):                    # dump_from state offset up to end, text appended to file
+    fails = 0                                                   # error code of the last chunk or None if failed
+
+    while fails < 10:
+        n = CHUNK if end is None else min(CHUNK, end - state['offset'])
+        if n <= 0: return 0
+
+        ser.reset_input_buffer()
+        ser.write(bytes('dump_from {} {}\n'.format(state['offset'], n), 'utf-8'))
+        seq = 0
+        res = None
+
+        while True:
+            fr = readFrame()
+            if fr is None or fr == 'bad' or fr[1] != seq: break        # resume at last good frame
+            typ, seq, pay = fr
+            seq += 1
+
+            if typ == 'S':
+                ymd, hms, interval, channels, bits, fmt = struct.unpack('<IIIBBH', pay)
+                run = [fmt, interval, channels, bits]
+                date = datetime.strptime('{:08}{:06}'.format(ymd, hms), '%Y%m%d%H%M%S')
+
+                if run != state['run'] or date.isoformat() != state['next']:  # not the run going on
+                    file.write('S {} {:08} {:06} {} {} {}\n'.format(fmt, ymd, hms, interval, channels, bits))
+                    state['run'] = run
+                    state['first'] = state['first'] or [ymd, hms, interval]
+
+                state['next'] = date.isoformat()
+            elif typ == 'D':
+                words = struct.unpack('<{}H'.format(len(pay)//2), pay)
+                for i in range(0, len(words), 16):
+                    file.write(' '.join('0x{:04x}'.format(w) for w in words[i:i+16]) + '\n')
+
+                state['offset'] += len(pay)
+                state['next'] = (datetime.fromisoformat(state['next']) + timedelta(seconds=state['run'][1]*len(words))).isoformat()
+                file.flush()
+
+                if part:
+                    with open(part, 'w') as f:
+                        json.dump(state, f)
+
+                print('\r' + str(state['offset']), end='', flush=True)
+            elif typ == 'E':
+                res = struct.unpack('<Ii', pay[:8])
+                break
+
+        if res is None:
+            fails += 1
+            print(' transfer failed, resume at {}'.format(state['offset']))
+            time.sleep(1)
+            continue
+
+        fails = 0
+
+        if res[0] != 0 or res[1] < n:                           # error or all samples
+            return res[0]
+
+    return None
+
+def dumpResume():
+    part = DUMPFILE + '.part'                                   # progress: offset, run, first header
+    state = None
+
+    if os.path.exists(part) and input('resume interrupted dump (y/n)?\n') == 'y':
+        with open(part, 'r') as f:
+            state = json.load(f)
+
+    if state is None:
+        state = { 'offset': 0, 'run': None, 'next': None, 'first': None }
+        open(DUMPFILE, 'w').close()
+
+    print('dumping from {} ...'.format(state['offset']))
+    file = open(DUMPFILE, 'a')
+    err = fetch(file, state, None, part)
+
+    if err is None:
+        print(' error: dump failed, choose again to resume')
+        file.close()
+        return
+
+    first = state['first'] or [0, 0, 0]
+    file.write('\n{:08} {:06} {:06} {}\n'.format(first[0], first[1], first[2], state['offset']//2))
+    file.close()
+    os.remove(part)
+    print(' OK' if err == 0 else ' error: {}'.format(err))
+
+#-------------------------------------------------------------------------------
+
+def deviceId():                                                 # USB serial number of Pico, its flash id
+    for p in serial.tools.list_ports.comports():
+        if p.device == PORT and p.serial_number:
+            return p.serial_number
+
+    return PORT
+
+def loadSync():
+    if not os.path.exists(SYNCFILE): return {}
+
+    with open(SYNCFILE, 'r') as f:
+        return json.load(f)
+
+def saveSync(syncs):
+    with open(SYNCFILE + '.tmp', 'w') as f:
+        json.dump(syncs, f)
+
+    os.replace(SYNCFILE + '.tmp', SYNCFILE)
+
+def sync():
+    dev = deviceId()
+    syncs = loadSync()
+    state = syncs.get(dev, { 'seq': None, 'index': 0, 'size': 0, 'run': None, 'next': None })
+    archive = ARCHIVE.format(''.join(c if c.isalnum() else '_' for c in dev))
+
+    if not os.path.exists(archive) or os.path.getsize(archive) < state['size']:
+        state = { 'seq': None, 'index': 0, 'size': 0, 'run': None, 'next': None }   # archive gone, start anew
+
+    ser.reset_input_buffer()
+    ser.write(bytes('cursor {} {}\n'.format(state['seq'] or 0, state['index']), 'utf-8'))
+    res = str(ser.readline(), 'utf-8').strip().split()
+
+    if len(res) != 5 or not res[0].isdigit():
+        print('error: cursor failed ' + ' '.join(res))
+        return
+
+    count, offset, seq, index, gap = map(int, res)
+
+    if state['seq'] is not None and gap:
+        print('samples after the last sync are no longer on Pico, sync all stored')
+
+    if state['seq'] is None or gap:
+        offset = 0
+
+    print('syncing {} of {} samples to {} ...'.format(count - offset//2, count, archive))
+
+    with open(archive, 'a') as file:                            # cut what an interrupted sync left
+        file.truncate(state['size'])
+
+    file = open(archive, 'a')
+    st = { 'offset': offset, 'run': state['run'], 'next': state['next'], 'first': None }
+    err = fetch(file, st, count * 2)
+    file.close()
+
+    if err != 0:
+        print(' error: sync failed' if err is None else ' error: {}'.format(err))
+        return
+
+    syncs[dev] = { 'seq': seq, 'index': index, 'size': os.path.getsize(archive), 'run': st['run'], 'next': st['next'] }
+    saveSync(syncs)
+    print(' OK')
+
+def forgetSync():                                               # samples on Pico removed, next sync takes all
+    syncs = loadSync()
+    dev = deviceId()
+
+    if dev in syncs:
+        syncs[dev]['seq'] = None
+        saveSync(syncs)
+
+#-------------------------------------------------------------------------------
+
+def inputRange():
+    try:
+        fr = datetime.strptime(input('from YYYY-MM-DD HH:MM:SS\n'), '%Y-%m-%d %H:%M:%S')
+        to = datetime.strptime(input('to   YYYY-MM-DD HH:MM:SS\n'), '%Y-%m-%d %H:%M:%S')
+    except:
+        print('error: input not valid')
+        return None
+
+    return '{} {}'.format(calendar.timegm(fr.timetuple()), calendar.timegm(to.timetuple()))
+
+def dumpRange():
+    print('Dump Range (samples from <= time < to)')
+    rng = inputRange()
+
+    if rng:
+        dump('dump_range ' + rng)
+
+#-------------------------------------------------------------------------------
+
+def stats():
+    print('Stats (samples from <= time < to)')
+    rng = inputRange()
+
+    if not rng:
+        return
+
+    ser.write(bytes('stats ' + rng + '\n', 'utf-8'))
+    res = str(ser.readline(), 'utf-8').strip().split()
+
+    if len(res) != 5 or not res[0].isdigit():
+        print('error: stats failed ' + ' '.join(res))
+        return
+
+    print('samples {}  min {}  max {}  mean {}  stddev {}'.format(*res))
+
+#-------------------------------------------------------------------------------
+
+def fsstat():
+    ser.write(bytes('fsstat 0\n', 'utf-8'))
+    res = str(ser.readline(), 'utf-8').strip().split()
+
+    if len(res) != 5 or not res[0].isdigit():
+        print('error: fsstat failed ' + ' '.join(res))
+        return
+
+    log, bsize, bcount, bused, store = (int(x) for x in res)
+    print('store       {}'.format('LOG' if store else 'FILE'))
+    print('sample log  {} KB, reserved with either store'.format(log // 1024))
+    print('littlefs    {} KB, {} of {} blocks used'.format(bsize * bcount // 1024, bused, bcount))
+
+#-------------------------------------------------------------------------------
+
+def find():
+    print('Find (blocks with samples below or above a value)')
+    res = input('below or above and value, e.g. below 300\n').split()
+
+    try:
+        x = int(res[1])
+    except:
+        print('error: input not valid')
+        return
+
+    if res[0]!='below' and res[0]!='above':
+        print('error: input not valid')
+        return
+
+    dump('find_{} {}'.format(res[0], min(max(x, 0), 65535)))
+
+#-------------------------------------------------------------------------------
+
+def tail():
+    print('Tail (newest samples from Pico RAM, kept over RESET, lost on power off)')
+
+    try:
+        n = int(input('number of samples, 0 all\n'))
+    except:
+        print('error: input not valid')
+        return
+
+    dump('tail {}'.format(max(n, 0)))
+
+#-------------------------------------------------------------------------------
+
+def quantiles():
+    ser.write(bytes('quantiles 0\n', 'utf-8'))
+
+    for i in range(2):                                          # session and day
+        res = str(ser.readline(), 'utf-8').strip().split()
+
+        if len(res) != 6:
+            print('error: quantiles failed ' + ' '.join(res))
+            return
+
+        print('{:8} {}.{}.{} {}:{}:{}  samples {}  p1 {}  p50 {}  p99 {}'.format(res[0],
+            res[1][6:8], res[1][4:6], res[1][0:4], res[2][0:2], res[2][2:4], res[2][4:6], *res[3:]))
+
+#-------------------------------------------------------------------------------
+
+def dumpTier():
+    print('Dump Tier (mean, min and max of every 10^n samples)')
+
+    try:
+        n = int(input('n 0..4\n'))
+    except:
+        print('error: input not valid')
+        return
+
+    dump('dump_tier {}'.format(min(max(n, 0), 4)))
+
+#-------------------------------------------------------------------------------
+
+def dumpDeci():
+    print('Dump Decimated (every n samples as one record, computed on Pico)')
+    res = input('avg, minmax or first and n, e.g. avg 10\n').split()
+
+    try:
+        n = int(res[1])
+    except:
+        print('error: input not valid')
+        return
+
+    if res[0] not in ('avg', 'minmax', 'first'):
+        print('error: input not valid')
+        return
+
+    dump('dump_{} {}'.format(res[0], min(max(n, 1), 65536)))
+
+#-------------------------------------------------------------------------------
+
 def visualize():
     logVis()
 
@@ -121,6 +505,7 @@ def remove():
 
     if res.lower() == 'y':
         send('remove')
+        forgetSync()
 
 #-------------------------------------------------------------------------------
 
@@ -130,6 +515,7 @@ def format():
 
     if res.lower() == 'y':
         send('format')
+        forgetSync()
 
 #-------------------------------------------------------------------------------
 
@@ -204,6 +590,90 @@ def setAppend():
 
 #-------------------------------------------------------------------------------
 
+def setSync():
+    print('Set Sync (1 .. 255 buffer flushes per file sync)')
+    res = input('flushes\n')
+
+    try:
+        sync = int(res)
+    except:
+        print('error: input not valid')
+        return
+
+    sync = min(max(sync, 1), 255)
+    send('set_sync', sync)
+
+#-------------------------------------------------------------------------------
+
+def setBatch():
+    print('Set Batch (256 .. 4096 bytes of samples written to flash at once)')
+    res = input('bytes\n')
+
+    try:
+        batch = int(res)
+    except:
+        print('error: input not valid')
+        return
+
+    batch = min(max(batch, 256), 4096) // 256 * 256
+    send('set_batch', batch)
+
+#-------------------------------------------------------------------------------
+
+def setMaxAge():
+    print('Set Max Age (samples not yet in flash are saved after)')
+    print('whole intervals, rounded down, at intervals of max age or above every sample is written')
+    res = input('HH:MM:SS\n')
+
+    hms = res.split(':')
+
+    if len(hms) != 3:
+        print('\033[Aerror: input not valid')
+        return
+
+    send('set_maxage', int(hms[0]) * 3600 + int(hms[1]) * 60 + int(hms[2]))
+
+#-------------------------------------------------------------------------------
+
+def setStore():
+    print('Set Store')
+    res = input('FILE (littlefs data file) or LOG (raw flash sample log)\n').upper()
+
+    if res!='FILE' and res!='LOG':
+        print('error: input not valid')
+        return
+
+    send('set_store', 1 if res=='LOG' else 0)
+
+#-------------------------------------------------------------------------------
+
+def setRing():
+    print('Set Ring (full sample log drops oldest samples)')
+    res = input('ON or OFF\n').upper()
+
+    if res!='ON' and res!='OFF':
+        print('error: input not valid')
+        return
+
+    send('set_ring', 1 if res=='ON' else 0)
+
+#-------------------------------------------------------------------------------
+
+def setSegment():
+    print('Set Segment (4 .. 256 KB per data segment file)')
+    res = input('KB\n')
+
+    try:
+        kb = int(res)
+    except:
+        print('error: input not valid')
+        return
+
+    kb = min(max(kb, 4), 256) // 4 * 4
+    send('set_segment', kb)
+
+#-------------------------------------------------------------------------------
+
 def init():
     ser.write(bytes('test {}\n'.format(12345), 'utf-8'))
     res = str(ser.readline(), 'utf-8').strip()
@@ -228,8 +698,13 @@ init()                                      # send some data to reset buffers
 while True:
     print()
     print('(s)ample     (d)ump           (v)isualize    (x)exit')
-    print('(r)emove     (f)ormat         (a)dc')
-    print('(1)set date  (2)set interval  (3)set append')
+    print('(w)dump range (q)find         (t)dump tier    (m)stats')
+    print('(p)quantiles  (l)tail          (b)dump binary  (c)dump resumable')
+    print('(e)dump deci  (y)sync')
+    print('(r)emove     (f)ormat         (a)dc           (o)flash')
+    print('(1)set date  (2)set interval  (3)set append   (4)set sync')
+    print('(5)set batch (6)set max age   (7)set store    (8)set ring')
+    print('(9)set segment')
     
     res = input('>')    
 
@@ -238,6 +713,26 @@ while True:
             sample()
         case 'd':
             dump()
+        case 'w':
+            dumpRange()
+        case 'q':
+            find()
+        case 't':
+            dumpTier()
+        case 'e':
+            dumpDeci()
+        case 'm':
+            stats()
+        case 'p':
+            quantiles()
+        case 'l':
+            tail()
+        case 'b':
+            dumpBin()
+        case 'c':
+            dumpResume()
+        case 'y':
+            sync()
         case 'v':
             visualize()
         case 'r':
@@ -246,12 +741,26 @@ while True:
             format()
         case 'a':
             adc()
+        case 'o':
+            fsstat()
         case '1':
             setDate()
         case '2':
             setInterval()
         case '3':
             setAppend()
+        case '4':
+            setSync()
+        case '5':
+            setBatch()
+        case '6':
+            setMaxAge()
+        case '7':
+            setStore()
+        case '8':
+            setRing()
+        case '9':
+            setSegment()
         case 'x':
             exitPgm()
         case _: